@@ -21,6 +21,18 @@ public:
     // (does X and Y bounds checking in Debug but not Release builds)
     virtual void SetPixel(int32_t X, int32_t Y, uint32_t color) = 0;
 
+    // Set pixels XStart thru XEnd (inclusive) of row Y to one color.
+    // Used by the rasterizer so each horizontal span costs one virtual call
+    // rather than one per pixel.
+    // (does X and Y bounds checking in Debug but not Release builds)
+    virtual void FillSpan(int32_t XStart, int32_t XEnd, int32_t Y, uint32_t color) = 0;
+
+    // Add photons to pixels XStart thru XEnd (inclusive) of row Y.
+    // Sums saturate at the maximum pixel value rather than wrap, so several
+    // sub-exposures can be accumulated directly into one canvas.
+    // (does X and Y bounds checking in Debug but not Release builds)
+    virtual void AddSpan(int32_t XStart, int32_t XEnd, int32_t Y, uint32_t photons) = 0;
+
     // Get pointer to pixel value buffer
     virtual void* GetFrameBuffer() = 0;
 
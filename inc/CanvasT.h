@@ -0,0 +1,135 @@
+#pragma once
+
+#ifndef __CanvasT_h__
+#define __CanvasT_h__
+
+#include <assert.h>
+#include <stdint.h> // int32_t, etc
+#include <string.h> // memset()
+#include <limits>
+
+#include "Canvas.h"
+
+// Canvas of grayscale (or packed color) pixels of unsigned integer type T.
+// Narrower pixels cut the memory traffic of rendering and of SpadSim, at the
+// cost of a smaller maximum photon count per pixel (AddSpan() saturates).
+template <typename T>
+class CanvasT : public Canvas
+{
+public:
+    // Pixels past the end of the frame buffer, so SIMD code can read 32 bits
+    // at any pixel (e.g. SpadSim gathers)
+    static const int32_t PAD = (sizeof(T) < 4) ? (int32_t)(4 / sizeof(T)) - 1 : 0;
+
+    CanvasT(
+        int32_t width,
+        int32_t height,
+        T*      pFB = nullptr) : // optional externally provided memory buffer
+                                 // (of width * height + PAD pixels)
+        Canvas(width, height)
+    {
+        // alloc pointers to rows
+        m_pFB = new T* [height];
+
+        // point first row to contiguous memory block
+        int32_t numPix = width * height;
+        if (pFB == nullptr)
+        {
+            m_externalFB = false;
+            m_pFB[0] = new T [numPix + PAD];
+            for (int32_t i = 0; i < PAD; ++i) { m_pFB[0][numPix + i] = 0; }
+        }
+        else
+        {
+            m_externalFB = true;
+            m_pFB[0] = pFB;
+        }
+
+        // set pointers to remaining rows
+        for (int i = 1; i < height; ++i) { m_pFB[i] = m_pFB[i - 1] + width; }
+    }
+
+    ~CanvasT(void)
+    {
+        if (m_externalFB == false) { delete [] m_pFB[0]; } // delete memory block
+        delete [] m_pFB;                                   // delete ptrs to rows
+    }
+
+    // set entire framebuffer to one color, truncated to the pixel type
+    void SetCanvas(uint32_t color)
+    {
+        uint32_t sz = m_width * m_height;
+        const T pixel = (T)color;
+
+        bool sameBytes = true; // e.g. black, white or gray of Canvas8
+        for (size_t i = 1; i < sizeof(T); ++i)
+        {
+            sameBytes = sameBytes && (((pixel >> (8 * i)) & 0xFFu) == (pixel & 0xFFu));
+        }
+        if (sameBytes)
+        {
+            memset(m_pFB[0], (int)(pixel & 0xFFu), sz * sizeof(T)); // use fast method
+        }
+        else // else use slower method
+        {
+            T* p = m_pFB[0];
+            while (sz--) { *p++ = pixel; }
+        }
+    }
+
+    // Set a pixel (without bounds checking in release builds)
+    inline void SetPixel(int32_t X, int32_t Y, uint32_t color)
+    {
+        assert((0 <= X) && (X < m_width));   // bounds check
+        assert((0 <= Y) && (Y < m_height));
+
+        m_pFB[Y][X] = (T)color; // no noise output
+    }
+
+    // Set pixels XStart thru XEnd (inclusive) of row Y to one color
+    // (without bounds checking in release builds)
+    inline void FillSpan(int32_t XStart, int32_t XEnd, int32_t Y, uint32_t color)
+    {
+        assert((0 <= XStart) && (XStart <= XEnd) && (XEnd < m_width)); // bounds check
+        assert((0 <= Y) && (Y < m_height));
+
+        // simple counted loop so the compiler can vectorize it
+        const T pixel = (T)color;
+        T* pRow = m_pFB[Y];
+        for (int32_t X = XStart; X <= XEnd; ++X) { pRow[X] = pixel; }
+    }
+
+    // Add photons to pixels XStart thru XEnd (inclusive) of row Y with
+    // saturation at the largest pixel value (without bounds checking in
+    // release builds)
+    inline void AddSpan(int32_t XStart, int32_t XEnd, int32_t Y, uint32_t photons)
+    {
+        assert((0 <= XStart) && (XStart <= XEnd) && (XEnd < m_width)); // bounds check
+        assert((0 <= Y) && (Y < m_height));
+
+        const T maxPixel = std::numeric_limits<T>::max();
+        const T add = (photons < maxPixel) ? (T)photons : maxPixel;
+
+        // branch-free saturating add so the compiler can vectorize the loop
+        T* pRow = m_pFB[Y];
+        for (int32_t X = XStart; X <= XEnd; ++X)
+        {
+            const T sum = (T)(pRow[X] + add);
+            pRow[X] = (sum < add) ? maxPixel : sum; // wrapped --> saturate
+        }
+    }
+
+    //T GetPixel(int32_t X, int32_t Y) { return m_pFB[Y][X]; }
+
+    void* GetFrameBuffer(void) { return m_pFB[0]; }
+
+private:
+    bool m_externalFB;
+    T**  m_pFB;
+};
+
+typedef CanvasT<uint8_t>  Canvas8;
+typedef CanvasT<uint16_t> Canvas16;
+typedef CanvasT<uint32_t> Canvas32;
+
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+
+#ifndef __DepthBuffer_h__
+#define __DepthBuffer_h__
+
+#include <assert.h>
+#include <stdint.h> // int32_t, etc
+#include <string.h> // memset()
+#include <vector>
+
+#include "RenderFXP.h" // Fixedpoint
+
+// Fractional bits of depth values interpolated by the rasterizer
+#define DEPTH_FBITS      (12u)
+#define DEPTH_MAX        (0xFFFF) // 16-bit depth of nearest representable point
+
+// Width in pixels of the coarse depth tiles (row segments) used to reject or
+// accept whole runs of a span without per-pixel depth tests
+#define DEPTH_TILE_SHIFT (5u)
+#define DEPTH_TILE_WIDTH (1 << DEPTH_TILE_SHIFT)
+
+// 16-bit fixed point depth buffer for use with RasterContext::pDepth.
+// Depth is proportional to 1 / distance so it interpolates linearly in screen
+// space:
+//     depth = DEPTH_MAX * depthNear / distance
+// Larger depth is nearer, 0 is infinitely far (the cleared value), and points
+// closer than depthNear saturate at DEPTH_MAX. Choose depthNear close to the
+// nearest expected object distance to get the most depth resolution.
+//
+// Each row is split into DEPTH_TILE_WIDTH pixel tiles with a conservative
+// minimum (farthest) and maximum (nearest) of the depths stored in the tile.
+// Tiles only cover pixels of one row, so threads drawing different rows
+// (e.g. bands) never share tiles.
+class DepthBuffer
+{
+public:
+    DepthBuffer(
+        int32_t    width,
+        int32_t    height,
+        Fixedpoint depthNear) : // distance that maps to DEPTH_MAX
+        m_width(width),
+        m_height(height),
+        m_tilesPerRow((width + DEPTH_TILE_WIDTH - 1) >> DEPTH_TILE_SHIFT),
+        m_depthNear(depthNear)
+    {
+        assert(depthNear > 0);
+        m_depth.resize((size_t)width * height);
+        m_tileMin.resize((size_t)m_tilesPerRow * height);
+        m_tileMax.resize((size_t)m_tilesPerRow * height);
+        Clear();
+    }
+
+    // set entire buffer to infinitely far
+    void Clear(void) { ClearRows(0, m_height - 1); }
+
+    // set rows YMin thru YMax to infinitely far
+    void ClearRows(int32_t YMin, int32_t YMax)
+    {
+        assert((0 <= YMin) && (YMin <= YMax) && (YMax < m_height));
+        const int32_t numRows = YMax - YMin + 1;
+        memset(Row(YMin),     0, (size_t)numRows * m_width       * sizeof(uint16_t));
+        memset(TileMin(YMin), 0, (size_t)numRows * m_tilesPerRow * sizeof(uint16_t));
+        memset(TileMax(YMin), 0, (size_t)numRows * m_tilesPerRow * sizeof(uint16_t));
+    }
+
+    // Convert view space Z (negative in front of the viewpoint) to depth with
+    // DEPTH_FBITS fractional bits
+    inline int32_t ViewZToDepth(Fixedpoint viewZ) const
+    {
+        const int64_t dist = -(int64_t)viewZ;
+        if (dist <= m_depthNear) { return DEPTH_MAX << DEPTH_FBITS; } // saturate
+        return (int32_t)(((int64_t)m_depthNear * (DEPTH_MAX << DEPTH_FBITS)) / dist);
+    }
+
+    // Per-row access for the rasterizer
+    inline uint16_t* Row    (int32_t Y) { return m_depth.data()   + (size_t)Y * m_width;       }
+    inline uint16_t* TileMin(int32_t Y) { return m_tileMin.data() + (size_t)Y * m_tilesPerRow; }
+    inline uint16_t* TileMax(int32_t Y) { return m_tileMax.data() + (size_t)Y * m_tilesPerRow; }
+
+    inline int32_t Width(void)  const { return m_width;  }
+    inline int32_t Height(void) const { return m_height; }
+
+private:
+    int32_t    m_width;
+    int32_t    m_height;
+    int32_t    m_tilesPerRow;
+    Fixedpoint m_depthNear;
+
+    std::vector<uint16_t> m_depth;   // per pixel depth
+    std::vector<uint16_t> m_tileMin; // per tile lower bound of stored depths
+    std::vector<uint16_t> m_tileMax; // per tile upper bound of stored depths
+};
+
+#endif
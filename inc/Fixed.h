@@ -0,0 +1,114 @@
+// Header only fixed point math core. Everything is constexpr and inline so
+// the compiler can fold constants and inline (and vectorize) the transform
+// loops that call it. The number of fractional bits and the rounding mode
+// are template parameters; RenderFXP.h instantiates them for Fixedpoint
+// (FIXED_FBITS fractional bits, truncation toward zero).
+
+#pragma once
+
+#ifndef __Fixed_h__
+#define __Fixed_h__
+
+#include <stdint.h> // int32_t, etc
+
+// Rounding of the results of fixed point multiply and divide
+enum FixedRound
+{
+    FIXED_ROUND_TRUNC   = 0, // toward zero, e.g. -1.5 --> -1 (C integer division)
+    FIXED_ROUND_NEAREST = 1, // to nearest, halves away from zero, e.g. -1.5 --> -2
+    FIXED_ROUND_FLOOR   = 2  // toward -infinity, e.g. -1.5 --> -2, 1.5 --> 1
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// num / den with rounding, den != 0
+template <FixedRound ROUND> constexpr int64_t FixedRoundDiv(int64_t num, int64_t den)
+{
+    // Note: downshift of a signed value is implementation defined so we use
+    // an actual divide here. The compiler replaces a divide by a constant
+    // power of 2 with shifts.
+    int64_t quot = num / den; // truncated
+    const int64_t rem = num % den;
+    const bool negative = (num < 0) != (den < 0);
+    if ((ROUND == FIXED_ROUND_NEAREST) && (rem != 0))
+    {
+        const int64_t absRem = (rem < 0) ? -rem : rem;
+        const int64_t absDen = (den < 0) ? -den : den;
+        if (2 * absRem >= absDen) { quot += negative ? -1 : 1; }
+    }
+    else if ((ROUND == FIXED_ROUND_FLOOR) && (rem != 0) && negative)
+    {
+        quot -= 1;
+    }
+    return quot;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Multiply and divide of raw fixed point values with FBITS fractional bits.
+// FixedDivT() does "den = (den == 0) ? 1 : den" to avoid div-by-0
+template <uint32_t FBITS, FixedRound ROUND = FIXED_ROUND_TRUNC>
+constexpr int32_t FixedMulT(int32_t a, int32_t b) // result = a * b
+{
+    return (int32_t)FixedRoundDiv<ROUND>((int64_t)a * b, (int64_t)1 << FBITS);
+}
+
+template <uint32_t FBITS, FixedRound ROUND = FIXED_ROUND_TRUNC>
+constexpr int32_t FixedDivT(int32_t num, int32_t den) // result = num / den
+{
+    return (int32_t)FixedRoundDiv<ROUND>((int64_t)num * ((int64_t)1 << FBITS), (den == 0) ? 1 : den);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Fixed point value type: int32_t with FBITS fractional bits, e.g.
+// Fixed<16> is Q16.16. Same size as int32_t, operators are inline and
+// constexpr:
+//     constexpr Fixed<16> half = Fixed<16>::FromDouble(0.5);
+//     static_assert((half * 3).ToInt() == 2, "1.5 rounds to 2");
+template <uint32_t FBITS, FixedRound ROUND = FIXED_ROUND_TRUNC>
+class Fixed
+{
+public:
+    static_assert((0 < FBITS) && (FBITS < 31), "FBITS must leave integer and sign bits");
+    static const int32_t ONE  = 1 << FBITS;
+    static const int32_t HALF = 1 << (FBITS - 1);
+
+    int32_t raw; // value * (1 << FBITS)
+
+    constexpr Fixed(void) : raw(0) {}
+
+    static constexpr Fixed FromRaw(int32_t raw)     { return Fixed(raw, 0); }
+    static constexpr Fixed FromInt(int32_t x)       { return Fixed(x * ONE, 0); }
+    static constexpr Fixed FromDouble(double x)     // rounded to nearest
+    {
+        return Fixed((int32_t)((x < 0.0) ? (x * ONE - 0.5) : (x * ONE + 0.5)), 0);
+    }
+
+    constexpr int32_t ToInt(void)    const // rounded, halves up
+    {
+        return (int32_t)FixedRoundDiv<FIXED_ROUND_FLOOR>((int64_t)raw + HALF, ONE);
+    }
+    constexpr double  ToDouble(void) const { return raw / (double)ONE; }
+
+    constexpr Fixed operator+(Fixed b) const { return FromRaw(raw + b.raw); }
+    constexpr Fixed operator-(Fixed b) const { return FromRaw(raw - b.raw); }
+    constexpr Fixed operator-(void)    const { return FromRaw(-raw); }
+    constexpr Fixed operator*(Fixed b) const { return FromRaw(FixedMulT<FBITS, ROUND>(raw, b.raw)); }
+    constexpr Fixed operator/(Fixed b) const { return FromRaw(FixedDivT<FBITS, ROUND>(raw, b.raw)); }
+    constexpr Fixed operator*(int32_t b) const { return FromRaw(raw * b); } // exact
+
+    Fixed& operator+=(Fixed b) { raw += b.raw; return *this; }
+    Fixed& operator-=(Fixed b) { raw -= b.raw; return *this; }
+    Fixed& operator*=(Fixed b) { return *this = *this * b; }
+    Fixed& operator/=(Fixed b) { return *this = *this / b; }
+
+    constexpr bool operator==(Fixed b) const { return raw == b.raw; }
+    constexpr bool operator!=(Fixed b) const { return raw != b.raw; }
+    constexpr bool operator< (Fixed b) const { return raw <  b.raw; }
+    constexpr bool operator<=(Fixed b) const { return raw <= b.raw; }
+    constexpr bool operator> (Fixed b) const { return raw >  b.raw; }
+    constexpr bool operator>=(Fixed b) const { return raw >= b.raw; }
+
+private:
+    constexpr Fixed(int32_t rawValue, int) : raw(rawValue) {}
+};
+
+#endif
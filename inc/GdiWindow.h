@@ -58,6 +58,26 @@ public:
         m_pRgb[Y * m_width + X] = color;
     }
 
+    // Set pixels XStart thru XEnd (inclusive) of row Y to one color
+    void FillSpan(int32_t XStart, int32_t XEnd, int32_t Y, uint32_t color)
+    {
+        uint32_t* pRow = m_pRgb + Y * m_width;
+        for (int32_t X = XStart; X <= XEnd; ++X) { pRow[X] = color; }
+    }
+
+    // Add photons to the gray level of pixels XStart thru XEnd (inclusive) of
+    // row Y, saturating at 255 and writing back as gray R = G = B
+    void AddSpan(int32_t XStart, int32_t XEnd, int32_t Y, uint32_t photons)
+    {
+        uint32_t* pRow = m_pRgb + Y * m_width;
+        for (int32_t X = XStart; X <= XEnd; ++X)
+        {
+            uint32_t gray = (pRow[X] & 0xFFu) + photons;
+            if ((gray > 255u) || (gray < photons)) { gray = 255u; }
+            pRow[X] = (gray << 16) | (gray << 8) | gray;
+        }
+    }
+
     void* GetFrameBuffer(void) { return m_pRgb; }
 
     // GdiWindow functions------------------------------------------------------
@@ -6,7 +6,6 @@
 // Instead int32_t are used with 16 fractional bits so it works on CPU's
 // without FPU (like RP2040).
 //
-// TODO: add z-buffer or back-to-front rendering of objects
 // TODO: add (U,V) coordinates to vertices for texture mapping
 
 #pragma once
@@ -15,17 +14,15 @@
 #define __RenderFXP_h__
 
 #include <stdint.h> // int32_t, etc
+#include <vector>
 #include "Canvas.h" // Canvas class to abstract pixel type (e.g. RGB, grayscale, etc)
-
-// Maximum screen height in pixels that is supported
-// (arbitrary, OK to modify this)
-#define MAX_SCREEN_HEIGHT 2048u
+#include "Fixed.h"  // FixedMulT(), FixedDivT(), Fixed value type
 
 #define FIXED_FBITS        (16u) // fractional bits in Fixedpoint number
 #define FIXED_ONE          (1 <<  FIXED_FBITS)      // 1.0
 #define FIXED_HALF         (1 << (FIXED_FBITS - 1)) // 0.5, for rounding
 #define FIXED_FBITS_MASK   (FIXED_ONE - 1)
-#define INT_TO_FIXED(x)    (((Fixedpoint)x) << FIXED_FBITS)
+#define INT_TO_FIXED(x)    ((Fixedpoint)(x) * FIXED_ONE) // not <<, x may be negative
 #define FIXED_TO_INT(x)    ((int)(((x) + FIXED_HALF) >> FIXED_FBITS))
 #define DOUBLE_TO_FIXED(x) ((Fixedpoint)(x * (1 << FIXED_FBITS) + 0.5))
 #define FIXED_TO_DOUBLE(x) (x / (double)FIXED_ONE)
@@ -63,13 +60,50 @@ typedef struct {
    Fixedpoint MaxX, MaxY, MaxZ;
 } MoveControl;
 
+// How polygon pixels are combined with pixels already on the canvas
+typedef enum {
+   RASTER_SET = 0, // overwrite pixels with polygon color
+   RASTER_ADD = 1  // add polygon photons to pixels (saturating), used to sum
+                   // sub-exposures for motion blur
+} RasterOp;
+
+// Describes beginning and ending X coordinates of a single horizontal line
+typedef struct { int32_t XStart; int32_t XEnd; } HLine;
+
+class DepthBuffer; // see DepthBuffer.h
+
+// Rasterizer state: the canvas to draw to, how pixels are combined, the Y
+// clip range and scan line scratch space sized to the canvas (so there is no
+// limit on screen height and nothing large on the stack per polygon).
+// FillConvexPolygon() only touches the context it's given, so each thread
+// can hold its own context and rasterize concurrently.
+// An optional depth buffer makes nearer polygons hide farther ones regardless
+// of draw order. Contexts of different threads can share one depth buffer so
+// long as their clip ranges don't overlap.
+struct RasterContext {
+   RasterContext(Canvas* pCanvasToDraw) :
+      pCanvas(pCanvasToDraw),
+      Rop(RASTER_SET),
+      YClipMin(0),
+      YClipMax(pCanvasToDraw->Height() - 1),
+      pDepth(nullptr),
+      HLines(pCanvasToDraw->Height()) { }
+
+   Canvas*            pCanvas;  // canvas to draw to
+   RasterOp           Rop;      // overwrite or add to pixels
+   int32_t            YClipMin; // only draw scan lines YClipMin
+   int32_t            YClipMax; //                 thru YClipMax
+   DepthBuffer*       pDepth;   // depth test and write, nullptr = off
+   std::vector<HLine> HLines;   // scratch, one scan line per canvas row
+};
+
 // structure describing a polygon-based object
 typedef struct t_PObject PObject;
 
 struct t_PObject {
    // fields common to every object
    void          (*RecalcFunc)(PObject*, Canvas*, Fixedpoint); // transform object vertices
-   void          (*DrawFunc)  (PObject*, Canvas*); // draw object to canvas
+   void          (*DrawFunc)  (PObject*, RasterContext*); // draw object to canvas
    void          (*MoveFunc)  (PObject*);          // move/rotate object, set RecalcXform
    int32_t       RecalcXform;                      // 1 to flag need to call RecalcFunc
 
@@ -89,15 +123,35 @@ struct t_PObject {
    Point3*       XformedVertexList;   // xformed into view space
    Point3*       ProjectedVertexList; // projected into screen space
    Point*        ScreenVertexList;    // converted to screen coordinates
+   Point3        CenterInView;        // centroid of XformedVertexList
    int32_t       NumFaces;            // # of faces in object (# of polygons)
    Face*         FaceList;            // pointer to face info
+
+   Fixedpoint    BoundRadius;         // radius of bounding sphere about object
+                                      // origin (0 = compute when first needed)
 };
 
+// Sensor exposure timing used by RenderRollingShutter()
+typedef struct {
+   int32_t LinesPerGroup;   // # of rows that expose at the same time
+   int32_t ExposureUsec;    // exposure time of each line group
+   int32_t ReadoutUsec;     // delay between start of consecutive line groups
+   int32_t NumSubExposures; // renders summed per line group (for motion blur)
+   int32_t MoveUsec;        // time that one MoveFunc call (Move and Rotate
+                            // increments) represents
+} RollingShutter;
+
 ////////////////////////////////////////////////////////////////////////////////
-// Multiply and divide operations for Fixedpoint.
+// Multiply and divide operations for Fixedpoint, truncated toward zero.
 // FixedDiv() does "den = (den == 0) ? 1 : den" to avoid div-by-0
-Fixedpoint FixedMul(Fixedpoint   a, Fixedpoint   b); // result = a * b
-Fixedpoint FixedDiv(Fixedpoint num, Fixedpoint den); // result = num / den
+constexpr Fixedpoint FixedMul(Fixedpoint   a, Fixedpoint   b) // result = a * b
+{
+    return FixedMulT<FIXED_FBITS>(a, b);
+}
+constexpr Fixedpoint FixedDiv(Fixedpoint num, Fixedpoint den) // result = num / den
+{
+    return FixedDivT<FIXED_FBITS>(num, den);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 /* Matrix multiplies Xform by SourceVec, and stores the result in DestVec.
@@ -109,13 +163,41 @@ Fixedpoint FixedDiv(Fixedpoint num, Fixedpoint den); // result = num / den
    [dst2] = [e f g h] * [src2]
    [dst3]   [i j k l]   [src3]
    [ 1  ]   [0 0 0 1]   [  1 ] */
-void XformVec(Xform xform3x4, Fixedpoint* SrcVec3x1, Fixedpoint* DstVec3x1);
+inline void XformVec(Xform xform3x4, Fixedpoint* SrcVec3x1, Fixedpoint* DstVec3x1)
+{
+   for (int i=0; i < 3; i++)
+   {
+      DstVec3x1[i] = FixedMul(xform3x4[i][0], SrcVec3x1[0]) +
+                     FixedMul(xform3x4[i][1], SrcVec3x1[1]) +
+                     FixedMul(xform3x4[i][2], SrcVec3x1[2]) +
+                              xform3x4[i][3]; // * SrcVec3x1[3] = W = 1.0
+   }
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 /* Matrix multiplies Src1 by Src2 and stores result in Dest.
    Cheats by assuming bottom row of each matrix is 0 0 0 1, and doesn't bother
    to set the bottom row of the destination. */
-void ConcatXforms(Xform Src1, Xform Src2, Xform Dest);
+/* Example:
+   Dest          = Src1          * Src2
+
+   [da db dc dd]   [a1 b1 c1 d1]   [a2 b2 c2 d2]
+   [de df df dh] = [e1 f1 g1 h1] * [e2 f2 g2 h2]
+   [di dj dk dl]   [i1 j1 k1 l1]   [i2 j2 k2 l2]
+   [ 0  0  0  1]   [ 0  0  0  1]   [ 0  0  0  1] */
+inline void ConcatXforms(Xform Src1, Xform Src2, Xform Dest)
+{
+   for (int i=0; i < 3; i++)    // loop thru rows of Dest
+   {
+      for (int j=0; j < 4; j++) // loop thru columns of Dest
+      {
+         Dest[i][j] = FixedMul(Src1[i][0], Src2[0][j]) +
+                      FixedMul(Src1[i][1], Src2[1][j]) +
+                      FixedMul(Src1[i][2], Src2[2][j]) +
+                               Src1[i][3]; // * Src2[3][3] = 1
+      }
+   }
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 /* Color-fills a convex 2D polygon. All vertices are offset by (XOffset,
@@ -126,19 +208,32 @@ void ConcatXforms(Xform Src1, Xform Src2, Xform Dest);
   right & left edges never cross. (It's OK for them to touch, though,
   so long as the right edge never crosses over to the left of the
   left edge.) Nonconvex polygons won't be drawn properly. Returns 1
-  for success, 0 if memory allocation failed. */
+  for success, 0 if the context's scratch space is too small.
+  The context's Rop selects whether color overwrites (RASTER_SET) or is
+  added to (RASTER_ADD) the canvas pixels. Only scan lines YClipMin thru
+  YClipMax of the context are scan converted and drawn.
+  If the context has a depth buffer and DepthPtr gives the depth of each
+  vertex (DepthBuffer::ViewZToDepth()) then only pixels at least as near as
+  the depth buffer are drawn and their depth is written. Otherwise the
+  polygon is drawn without depth test (e.g. for overlays). */
 int32_t FillConvexPolygon(
-    Point * PointPtr,
-    int32_t Length,
-    int32_t color,
-    int32_t XOffset, int32_t YOffset,
-    Canvas* pCanvas);
+    Point *        PointPtr,
+    int32_t        Length,
+    int32_t        color,
+    int32_t        XOffset, int32_t YOffset,
+    RasterContext* pContext,
+    const int32_t* DepthPtr = nullptr);
 
 ////////////////////////////////////////////////////////////////////////////////
 /* Draws all visible faces in specified polygon-based object. Object must have
    previously been transformed and projected, so that ScreenVertexList array is
-   filled in. */
-void DrawPObject(PObject *, Canvas*);            // DrawFunc
+   filled in. With RASTER_ADD each face adds its Color photons to the canvas
+   so repeated calls accumulate sub-exposures in place. Only scan lines
+   within the context's clip range are drawn. Faces are depth tested if the
+   context has a depth buffer. Note that with RASTER_ADD a hidden face that is
+   drawn before the face hiding it still adds its photons, so draw objects
+   front to back. */
+void DrawPObject(PObject *, RasterContext*);     // DrawFunc
 
 ////////////////////////////////////////////////////////////////////////////////
 /* Transforms all vertices in the specified polygon-based object into view
@@ -150,6 +245,43 @@ void DrawPObject(PObject *, Canvas*);            // DrawFunc
 */
 void XformAndProjectPObject(PObject *, Canvas*, Fixedpoint nearClipZ); // RecalcFunc
 
+////////////////////////////////////////////////////////////////////////////////
+/* Renders a rolling shutter frame, one line group at a time:
+     For each line group:
+         Init lines of the group to zero photons
+         For each sub-exposure:
+             Advance object poses to the sub-exposure time
+             Skip objects whose bounding sphere misses the group's rows
+             Project remaining objects and add their photons to the group
+   Group g starts exposing at g * ReadoutUsec and each sub-exposure is
+   rendered at the middle of its share of ExposureUsec. Face Color is the
+   number of photons a face adds per sub-exposure.
+   Poses are extrapolated from each object's current XformToWorld using its
+   Move and Rotate increments (averaged over the delay counts) where one
+   MoveFunc call spans MoveUsec. Bounces off the Move bounding box are not
+   modeled within a frame. XformToWorld is left unchanged, so call MoveFunc
+   afterwards as usual to advance to the next frame.
+   The context's Rop and clip range are restored on return. If the context
+   has a depth buffer, its rows are cleared for each sub-exposure. */
+void RenderRollingShutter(
+    PObject**             ObjectList,
+    int32_t               NumObjects,
+    RasterContext*        pContext,
+    Fixedpoint            nearClipZ,
+    const RollingShutter* pShutter);
+
+////////////////////////////////////////////////////////////////////////////////
+/* Sorts objects back to front (ascending CenterInView.Z) for painter's
+   algorithm drawing, so nearer objects are drawn over farther ones without
+   a z-buffer. Draw the list in reverse for front to back (most hidden
+   pixels rejected early by a z-buffer, and required for RASTER_ADD with a
+   z-buffer). Objects must have been projected this frame.
+   An insertion sort is used in place: objects move little between frames,
+   so re-sorting last frame's order costs about NumObjects compares. Objects
+   with equal Z keep their order. Sorting by center is approximate; objects
+   that are large relative to their separation can still be misordered. */
+void SortObjects(PObject** ObjectList, int32_t NumObjects);
+
 ////////////////////////////////////////////////////////////////////////////////
  /* Rotates and moves a polygon-based object around the three axes.
    Movement is implemented only along the Z axis currently. */
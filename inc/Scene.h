@@ -0,0 +1,46 @@
+// Rotating cubes and cow scene of the example programs, shared by the
+// Windows GUI (CubeTest) and the headless frame generator (SensorSim)
+
+#pragma once
+
+#ifndef __Scene_h__
+#define __Scene_h__
+
+#include <stdint.h> // int32_t, etc
+#include <vector>
+
+#include "RenderFXP.h"
+#include "WorkerPool.h"
+
+#define NUM_CUBES 12 /* # of objects: 11 cubes and the cow */
+
+extern int      NumObjects;
+extern PObject* ObjectList[NUM_CUBES]; // pointers to objects
+
+// Set up fixed-point data
+void InitializeFixedPoint();
+
+// Initialize the cubes (and cow) and add them to the object list
+void InitializeCubes();
+
+// Free the objects of InitializeCubes()
+void FreeCubes();
+
+// Draw all objects (and optional grid) to rows YMin thru YMax of canvas
+void RenderBand(
+    PObject*       ObjectList[NUM_CUBES],
+    RasterContext& context,
+    int32_t        YMin,
+    int32_t        YMax,
+    bool           enableGrid);
+
+// Draw the next frame of the scene to canvas with one band per worker of
+// pool, then move the objects
+void Render(
+    PObject*                    ObjectList[NUM_CUBES],
+    Canvas&                     canvas,
+    WorkerPool&                 pool,
+    std::vector<RasterContext>& contexts, // one per worker
+    bool                        enableGrid = false);
+
+#endif
@@ -3,23 +3,79 @@
 #ifndef __SpadSim_h__
 #define __SpadSim_h__
 
+#include <assert.h>
+#include <stdint.h> // int32_t, etc
+#include <string.h> // memset()
+#include <math.h>   // sqrtf(), exp2f()
+#include <limits>
 #include <vector>
 #include <array>
-#include "random.h" // PoissonDist
+#include <utility>  // std::index_sequence
+#include <algorithm> // std::sort()
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include "random.h" // PoissonDist, Rng
 
 class SpadSim
 {
 public:
+    // Optional stages of the AddDistortion() pipeline, combined as a bitmask
+    enum Stage : uint32_t
+    {
+        STAGE_LENS_DIST = 1u << 0, // barrel/pincushion
+        STAGE_DF        = 1u << 1, // dark frame
+        STAGE_PWL       = 1u << 2, // PWL compression
+        STAGE_BILINEAR  = 1u << 3, // bilinear lens distortion (else nearest)
+        STAGE_BLUR      = 1u << 4, // lens blur (PSF convolution)
+        NUM_STAGE_COMBOS = 1u << 5
+    };
+
+    // Output frame formats of AddDistortionFormat(). 8-bit formats hold the
+    // pixel compressed by STAGE_PWL, or else clipped to 8 bits. Wider formats
+    // hold the linear pixel clipped to their bits when STAGE_PWL is disabled.
+    enum OutputFormat : uint32_t
+    {
+        OUTPUT_BGRX   = 0, // uint32_t gray BGRX, the format of GdiWindow
+        OUTPUT_GRAY8  = 1, // uint8_t
+        OUTPUT_GRAY16 = 2, // uint16_t
+        OUTPUT_RAW10  = 3, // MIPI CSI-2 RAW10: 4 pixels in 5 bytes, the high
+                           // 8 bits of each then the low 2 bits of all 4
+        OUTPUT_RAW12  = 4, // MIPI CSI-2 RAW12: 2 pixels in 3 bytes, the high
+                           // 8 bits of each then the low 4 bits of both
+        NUM_OUTPUT_FORMATS
+    };
+
+    // Largest lens blur kernel radius of SetBlurKernel() and SetBlurKernel2D()
+    static const int MAX_BLUR_RADIUS    = 7;
+    static const int MAX_BLUR_RADIUS_2D = 2;
+    static const int MAX_BLUR_ZONES     = 8; // radial zones of SetBlurZones()
+
+    // Largest noiseLUTMax of the constructor (12-bit pixels, the PWL input)
+    static const uint32_t NOISE_LUT_MAX = 4096;
+
+    // SetDarkFrame() rounds temperatures to 1 / DF_TEMP_STEPS degrees C and
+    // by default caches this many dark frames
+    static const int DF_TEMP_STEPS = 16;
+    static const int DF_CACHE_SIZE = 4;
 
     ////////////////////////////////////////////////////////////////////////////
     SpadSim(
         int32_t  width  = 1008,
         int32_t  height =  768,
-        uint32_t seedDF =    1u) :  // Dark frame random seed
+        uint32_t seedDF =    1u,    // Dark frame random seed
+        uint32_t seedNoise = 2u,    // Poisson noise random seed
+        uint32_t noiseLUTMax = NOISE_LUT_MAX) : // pixels below this get noise
+                                    // from LUTs, 256 thru NOISE_LUT_MAX
         m_width(width),
-        m_height(height)
+        m_height(height),
+        m_seedNoise(seedNoise),
+        m_frame(0),
+        m_noiseLUTMax(noiseLUTMax)
     {
         assert((width & 0x1) == 0); // bitmaps require even width
+        assert((height >= 2) && ((height & 0x1) == 0)); // InitRemap() fills rows -h/2 thru h/2 - 1
+        assert((256u <= noiseLUTMax) && (noiseLUTMax <= NOISE_LUT_MAX));
 
         // Compute constants
         const int numPix = width * height;
@@ -45,10 +101,8 @@ public:
             // field of view is unchanged in distorted image.
             scale /= scaleHFOV;
 
-            // final scale factor with 8 fractional bits.
-            uint32_t value = (uint32_t)(scale * 256.0f + 0.5f); // round to int
-            assert(value <= std::numeric_limits<uint16_t>::max());
-            m_lensDistLUT[r] = (uint16_t)value;
+            // final scale factor with LENS_FBITS fractional bits.
+            m_lensDistLUT[r] = (uint32_t)(scale * (1 << LENS_FBITS) + 0.5f); // round to int
         }
 
         // relative illumination (aka lens vignetting)--------------------------
@@ -59,37 +113,89 @@ public:
             m_relativeIllumLUT[r] = (maxRadius - r) * 256 / maxRadius;
         }
 
+        // per pixel tables from radius LUTs
+        InitRemap();
+
+        // default lens blur (PSF) is a 3x3 binomial filter
+        const float binomial[3] = { 1.0f, 2.0f, 1.0f };
+        SetBlurKernel(binomial, binomial, 1);
+
         // generate dark frame--------------------------------------------------
 
         // DF at 60C sensor temperature and max exposure of 11111 microseconds (= 1/90)
-        m_pDF60.reserve(numPix);
-        m_pDF60.resize(numPix);
-        srand(seedDF);
-        PoissonDist<uint32_t>(2.0, numPix, m_pDF60.data()); // SPAD avg DF pixel value is 2.0 at 60C
+        std::vector<uint32_t> DF60(numPix);
+        Rng rng(seedDF);
+        PoissonDist<uint32_t>(2.0, numPix, DF60.data(), rng); // SPAD avg DF pixel value is 2.0 at 60C
 
-        // Add 1% hot pixels to pDF60
+        // Add 1% hot pixels to DF60
+        std::vector<uint8_t> isHot(numPix);
         const int numHot = 1 * numPix / 100;
         for (int ii = 0; ii < numHot; ++ii)
         {
             // random locations
-            uint32_t r = rand() % height;
-            uint32_t c = rand() % width;
+            uint32_t r = rng.Next32() % height;
+            uint32_t c = rng.Next32() % width;
 
             // Generate Poisson (with mean 80)
-            PoissonDist<uint32_t>(80.0f, 1u, m_pDF60.data() + r * width + c);
+            PoissonDist<uint32_t>(80.0f, 1u, DF60.data() + r * width + c, rng);
+            isHot[r * width + c] = 1;
         }
 
-        m_pDF.reserve(numPix);
-        m_pDF.resize(numPix);
+        // store as dense base plus sparse hot pixels
+        assert(width <= 65536); // HotPixel::X
+        m_df60.base.resize(numPix);
+        m_df60.hotRows.resize(height + 1);
+        m_df60BaseMax = 0;
+        for (int Y = 0; Y < height; ++Y)
+        {
+            m_df60.hotRows[Y] = (int32_t)m_df60.hot.size();
+            for (int X = 0; X < width; ++X)
+            {
+                const int idx = Y * width + X;
+                if (isHot[idx] || (DF60[idx] > 255u))
+                {
+                    const HotPixel hot = { (uint16_t)X, (uint16_t)std::min(DF60[idx], 0xFFFFu) };
+                    m_df60.hot.push_back(hot);
+                    m_df60.base[idx] = 0;
+                }
+                else
+                {
+                    m_df60.base[idx] = (uint8_t)DF60[idx];
+                    m_df60BaseMax = std::max(m_df60BaseMax, m_df60.base[idx]);
+                }
+            }
+        }
+        m_df60.hotRows[height] = (int32_t)m_df60.hot.size();
+
+        m_dfCacheSize = DF_CACHE_SIZE;
+        m_dfCache.reserve(m_dfCacheSize);
+        m_dfUse = 0;
         SetDarkFrame(60.0f, 7.0f, 11111u); // create initial dark frame
 
         // Create Poisson noise 2D LUT------------------------------------------
+        const int numBlocks = (width + NOISE_BLOCK - 1) >> NOISE_BLOCK_SHIFT;
+        m_noiseOffsets.resize((numBlocks + 3) & ~3); // whole random values
+        m_noiseStrides.resize((numBlocks + 3) & ~3);
         const uint32_t noiseHeight = 256; // >= largest pixel value
         const uint32_t noiseWidth  = 256; // large enough for accurate Poisson stats
         for (int r = 0; r < noiseHeight; ++r) // loop thru rows
         {
             uint16_t* pRow = m_noiseLUT.data() + r * noiseWidth;
-            PoissonDist<uint16_t>((float)r, noiseWidth, pRow); // Fill row with randp(r)
+            PoissonDist<uint16_t>((float)r, noiseWidth, pRow, rng); // Fill row with randp(r)
+        }
+
+        // Create Poisson noise LUTs for 256 <= pixel value < noiseLUTMax-------
+        // Noise is value + sqrt(value) * z, where z is from a row of
+        // standardized Poisson quantiles for a bucket of values (a row per
+        // value would be 2 MB rather than 24 KB). 256 columns as above.
+        for (int bucket = 256 >> NOISE_BUCKET_SHIFT; bucket < NUM_NOISE_BUCKETS; ++bucket)
+        {
+            const float lam = (float)((bucket << NOISE_BUCKET_SHIFT) + (1 << (NOISE_BUCKET_SHIFT - 1)));
+            InitNoiseQuantiles(lam, m_noiseQuantiles.data() + bucket * noiseWidth, rng);
+        }
+        for (uint32_t ii = 0; ii < NOISE_LUT_MAX; ++ii)
+        {
+            m_noiseSqrt[ii] = (uint16_t)(sqrtf((float)ii) * (1 << NOISE_SQRT_FBITS) + 0.5f);
         }
 
         // Set PWL LUT----------------------------------------------------------
@@ -124,110 +230,625 @@ public:
     //    time.  So 11/2 msec at 60C sensor temperture results in D60/2.
     //
     // Typical average pixel value is 0.17 for 30C and 2.0 for 60C at max exposure
+    //
+    // Temperature is rounded to 1 / DF_TEMP_STEPS degrees C. The most recently
+    // used dark frames are cached (see SetDarkFrameCacheSize()), so e.g. a
+    // thermal simulation sweeping temperature back and forth only rescales D60
+    // for temperatures and exposures it has not used recently.
     void SetDarkFrame(
         float     sensorTempC,  // in: sensor temperature in degrees C for pD
         float     doubleTempC,  // in: doubling temperature in degrees C
                                 //     (usually 7-9 for SPAD sensors)
         uint32_t  expTimeUsec)  // in: exposure time in micro seconds
     {
+        const int32_t tempQ = (int32_t)lroundf(sensorTempC * DF_TEMP_STEPS);
+        ++m_dfUse;
+
+        // find cached dark frame, else least recently used one to replace
+        DarkFrame* pDF = nullptr;
+        for (size_t ii = 0; ii < m_dfCache.size(); ++ii)
+        {
+            DarkFrame& df = m_dfCache[ii];
+            if ((df.tempQ == tempQ) && (df.doubleTempC == doubleTempC) && (df.expTimeUsec == expTimeUsec))
+            {
+                df.lastUse = m_dfUse;
+                m_pDF = &df.pixels;
+                return;
+            }
+            if ((pDF == nullptr) || (df.lastUse < pDF->lastUse)) { pDF = &df; }
+        }
+        if (m_dfCache.size() < m_dfCacheSize)
+        {
+            m_dfCache.emplace_back(); // no reallocation, capacity is m_dfCacheSize
+            pDF = &m_dfCache.back();
+        }
+        pDF->tempQ       = tempQ;
+        pDF->doubleTempC = doubleTempC;
+        pDF->expTimeUsec = expTimeUsec;
+        pDF->lastUse     = m_dfUse;
+
+        // scale is constant over the frame
         const uint32_t maxExpTimeUsec = 11111; // 90 fps
         const float exposureScale = (float)expTimeUsec / maxExpTimeUsec;
+        const float tempC = (float)tempQ / DF_TEMP_STEPS;
+        ScaleDarkFrame(exp2f((tempC - 60.0f) / doubleTempC) * exposureScale, pDF->pixels);
+        m_pDF = &pDF->pixels;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Set the number of dark frames cached by SetDarkFrame(), at least 1 (the
+    // current dark frame). Each costs about 1 byte per pixel.
+    void SetDarkFrameCacheSize(size_t numFrames)
+    {
+        assert(numFrames >= 1);
+
+        // keep the most recently used, the first is the current dark frame
+        std::sort(m_dfCache.begin(), m_dfCache.end(),
+            [](const DarkFrame& a, const DarkFrame& b) { return a.lastUse > b.lastUse; });
+        if (m_dfCache.size() > numFrames) { m_dfCache.resize(numFrames); }
+        m_dfCache.reserve(numFrames);
+        m_dfCacheSize = numFrames;
+        m_pDF = &m_dfCache[0].pixels;
+    }
 
-        uint32_t* pDF60 = m_pDF60.data();
-        uint32_t* pDF   = m_pDF.data();
-        size_t   count  = m_pDF60.size();
-        while (count--)
+    ////////////////////////////////////////////////////////////////////////////
+    // Set the lens blur point-spread function (PSF) of STAGE_BLUR to the
+    // separable kernel kernelY * kernelX, each of 2 * radius + 1 taps.
+    // Kernels are normalized so blur does not change brightness.
+    void SetBlurKernel(
+        const float* kernelX,  // in: horizontal taps, left to right
+        const float* kernelY,  // in: vertical taps, top to bottom
+        int          radius)   // in: 0 thru MAX_BLUR_RADIUS
+    {
+        SetBlurZones(kernelX, kernelY, nullptr, 1, radius);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Set a radially varying separable lens blur PSF (real lenses blur more
+    // towards the edge of the field). Zone z has kernels kernelsX and kernelsY
+    // + z * (2 * radius + 1) and covers radii (distance from image center in
+    // pixels) zoneRadius[z - 1] thru zoneRadius[z] - 1, the last zone covers
+    // the rest of the image. Use zero taps for zones with smaller kernels.
+    // Each row is split into runs of pixels in the same zone when the kernels
+    // are set, so blur just convolves each run with its zone's kernels.
+    void SetBlurZones(
+        const float* kernelsX,   // in: numZones horizontal kernels
+        const float* kernelsY,   // in: numZones vertical kernels
+        const int*   zoneRadius, // in: numZones - 1 increasing zone boundaries
+        int          numZones,   // in: 1 thru MAX_BLUR_ZONES
+        int          radius)     // in: 0 thru MAX_BLUR_RADIUS
+    {
+        assert((0 <= radius) && (radius <= MAX_BLUR_RADIUS));
+        assert((1 <= numZones) && (numZones <= MAX_BLUR_ZONES));
+        const int numTaps = 2 * radius + 1;
+        m_blurKernelX.resize(numZones * numTaps);
+        m_blurKernelY.resize(numZones * numTaps);
+        for (int zone = 0; zone < numZones; ++zone)
         {
-            float DmaxExp = *pDF60++ * exp2f((sensorTempC - 60.0f) / doubleTempC);
-            *pDF++ = (uint32_t)(DmaxExp * exposureScale + 0.5f);
+            QuantizeKernel(kernelsX + zone * numTaps, numTaps, m_blurKernelX.data() + zone * numTaps);
+            QuantizeKernel(kernelsY + zone * numTaps, numTaps, m_blurKernelY.data() + zone * numTaps);
         }
+        InitBlur(radius, true, zoneRadius, numZones);
     }
 
     ////////////////////////////////////////////////////////////////////////////
-    void AddDistortion(
-        const uint32_t* pRd,                     // input rendered frame
-        uint32_t*       pWr,                     // output frame
+    // Set a non-separable lens blur PSF of (2 * radius + 1)^2 taps in row
+    // major order. Costs (2 * radius + 1)^2 multiplies per pixel rather than
+    // 2 * (2 * radius + 1) so is limited to small kernels.
+    void SetBlurKernel2D(
+        const float* kernel,   // in: taps, top row first
+        int          radius)   // in: 0 thru MAX_BLUR_RADIUS_2D
+    {
+        assert((0 <= radius) && (radius <= MAX_BLUR_RADIUS_2D));
+        const int numTaps = 2 * radius + 1;
+        m_blurKernel2D.resize(numTaps * numTaps);
+        QuantizeKernel(kernel, numTaps * numTaps, m_blurKernel2D.data());
+        InitBlur(radius, false, nullptr, 1);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Add lens and sensor effects to a rendered frame, one row at a time.
+    // When compiled for AVX2 (e.g. -mavx2 or /arch:AVX2) rows are processed 8
+    // pixels at a time, otherwise by the scalar kernel. Both give the same
+    // output for the same frame number (see SetFrame()).
+    //
+    // Rendered frames are uint8_t, uint16_t or uint32_t pixels (e.g. from
+    // Canvas8, Canvas16 or Canvas32). Narrower pixels are read by 32-bit
+    // gathers so must be followed by 3 readable bytes, which CanvasT
+    // allocates. Output frames are uint32_t (OUTPUT_BGRX), uint16_t
+    // (OUTPUT_GRAY16) or uint8_t (OUTPUT_GRAY8) pixels, see
+    // AddDistortionFormat() for packed formats.
+    template <typename TIn, typename TOut> void AddDistortion(
+        const TIn*      pRd,                     // input rendered frame
+        TOut*           pWr,                     // output frame
         bool            enableLensDist = true,   // barrel/pincushion
         bool            enableDF       = true,   // enable dark frame
         bool            enablePWL      = true)   // enable PWL
     {
-        const int widthDiv2  = m_width  / 2;
-        const int heightDiv2 = m_height / 2;
-        const int maxRadius2 = heightDiv2 * heightDiv2 +
-                                widthDiv2 * widthDiv2;
-        const int maxRadius = (int)sqrtf(static_cast<float>(maxRadius2));
+        AddDistortionStages(pRd, pWr, StageMask(enableLensDist, enableDF, enablePWL), true);
+    }
 
-        m_noiseIdx = rand() & 0xFFu; // avoid fixed noise when enableDF = false
+    ////////////////////////////////////////////////////////////////////////////
+    // Scalar only version of AddDistortion(), the reference for SIMD kernels
+    template <typename TIn, typename TOut> void AddDistortionScalar(
+        const TIn*      pRd,                     // input rendered frame
+        TOut*           pWr,                     // output frame
+        bool            enableLensDist = true,   // barrel/pincushion
+        bool            enableDF       = true,   // enable dark frame
+        bool            enablePWL      = true)   // enable PWL
+    {
+        AddDistortionStages(pRd, pWr, StageMask(enableLensDist, enableDF, enablePWL), false);
+    }
 
-        // Add sensor and lens effects to rendered frame
-        const uint32_t* pDF = m_pDF.data();
-        for (int r = -heightDiv2; r < heightDiv2; ++r)
+    ////////////////////////////////////////////////////////////////////////////
+    // AddDistortion() with the enabled stages given as a bitmask of Stage.
+    // Each combination of stages has its own compiled pipeline, so the per
+    // pixel loops have no tests of disabled stages.
+    // STAGE_BILINEAR samples lens distortion with sub-pixel accuracy (so no
+    // need to render at higher resolution and downsample), it requires
+    // rendered pixel values < 2^23.
+    // STAGE_BLUR convolves the lens distorted frame with the PSF set by
+    // SetBlurKernel() or SetBlurKernel2D(), it requires rendered pixel values
+    // < 2^22.
+    template <typename TIn, typename TOut> void AddDistortionStages(
+        const TIn*      pRd,               // input rendered frame
+        TOut*           pWr,               // output frame
+        uint32_t        stages,            // bitmask of Stage
+        bool            enableSimd = true) // false = scalar kernel only
+    {
+        RunPipeline<TIn, FormatOf((TOut*)nullptr)>(pRd, (uint8_t*)pWr, stages, enableSimd);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // AddDistortionStages() with the output frame in any OutputFormat, each
+    // output row is OutputRowBytes() bytes. The output format is packed by
+    // the last stage of the pipeline, so there is no separate packing pass.
+    // OUTPUT_RAW10 requires width to be a multiple of 4.
+    template <typename TIn> void AddDistortionFormat(
+        const TIn*      pRd,               // input rendered frame
+        void*           pWr,               // output frame
+        uint32_t        stages,            // bitmask of Stage
+        OutputFormat    format,
+        bool            enableSimd = true) // false = scalar kernel only
+    {
+        uint8_t* pOut = (uint8_t*)pWr;
+        switch (format)
         {
-            // set up radius for first pixel of this row
-            // Note: due to cast to int: iradius * iradius <= radius2
-            int radius2 = r * r + widthDiv2 * widthDiv2;
-            int iradius = (int)sqrtf((float)radius2); // "integer radius"
+        case OUTPUT_BGRX:   RunPipeline<TIn, OUTPUT_BGRX  >(pRd, pOut, stages, enableSimd); break;
+        case OUTPUT_GRAY8:  RunPipeline<TIn, OUTPUT_GRAY8 >(pRd, pOut, stages, enableSimd); break;
+        case OUTPUT_GRAY16: RunPipeline<TIn, OUTPUT_GRAY16>(pRd, pOut, stages, enableSimd); break;
+        case OUTPUT_RAW10:  RunPipeline<TIn, OUTPUT_RAW10 >(pRd, pOut, stages, enableSimd); break;
+        case OUTPUT_RAW12:  RunPipeline<TIn, OUTPUT_RAW12 >(pRd, pOut, stages, enableSimd); break;
+        default: assert(false);
+        }
+    }
 
-            for (int c = -widthDiv2; c < widthDiv2; ++c)
+    ////////////////////////////////////////////////////////////////////////////
+    // Bytes per row of output frames in format
+    inline size_t OutputRowBytes(OutputFormat format) const
+    {
+        switch (format)
+        {
+        case OUTPUT_BGRX:   return (size_t)m_width * 4;
+        case OUTPUT_GRAY16: return (size_t)m_width * 2;
+        case OUTPUT_RAW10:  return (size_t)m_width * 5 / 4;
+        case OUTPUT_RAW12:  return (size_t)m_width * 3 / 2;
+        default:            return (size_t)m_width;
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Noise of a frame only depends on seedNoise and the frame number, which
+    // counts calls of AddDistortion(). Setting the frame number regenerates
+    // the noise of that frame, with each pixel from its own range of the
+    // frame's random stream (so noise does not depend on the order pixels are
+    // processed in).
+    inline void     SetFrame(uint64_t frame) { m_frame = frame; }
+    inline uint64_t Frame(void) const        { return m_frame; }
+
+    ////////////////////////////////////////////////////////////////////////////
+    static uint32_t StageMask(bool enableLensDist, bool enableDF, bool enablePWL)
+    {
+        return (enableLensDist ? STAGE_LENS_DIST : 0u) |
+               (enableDF       ? STAGE_DF        : 0u) |
+               (enablePWL      ? STAGE_PWL       : 0u);
+    }
+
+private:
+    ////////////////////////////////////////////////////////////////////////////
+    // Table of AddDistortionRows() for every combination of stages
+    template <typename TIn>
+    using Pipeline = void (SpadSim::*)(const TIn*, uint8_t*, bool);
+    template <typename TIn, uint32_t FORMAT, size_t... STAGES>
+    static const Pipeline<TIn>* PipelineTable(std::index_sequence<STAGES...>)
+    {
+        static const Pipeline<TIn> table[] = { &SpadSim::AddDistortionRows<STAGES, TIn, FORMAT>... };
+        return table;
+    }
+
+    template <typename TIn, uint32_t FORMAT> void RunPipeline(
+        const TIn*      pRd,
+        uint8_t*        pWr,
+        uint32_t        stages,
+        bool            enableSimd)
+    {
+        static const Pipeline<TIn>* pipelines =
+            PipelineTable<TIn, FORMAT>(std::make_index_sequence<NUM_STAGE_COMBOS>());
+
+        assert(stages < NUM_STAGE_COMBOS);
+        assert((FORMAT != OUTPUT_RAW10) || ((m_width & 0x3) == 0));
+        (this->*pipelines[stages & (NUM_STAGE_COMBOS - 1)])(pRd, pWr, enableSimd);
+    }
+
+    // Output format of output pixel type
+    static constexpr uint32_t FormatOf(const uint32_t*) { return OUTPUT_BGRX;   }
+    static constexpr uint32_t FormatOf(const uint16_t*) { return OUTPUT_GRAY16; }
+    static constexpr uint32_t FormatOf(const uint8_t*)  { return OUTPUT_GRAY8;  }
+
+    // Largest output pixel value of format
+    static constexpr uint32_t OutputMax(uint32_t format)
+    {
+        return (format == OUTPUT_GRAY16) ? 0xFFFFu :
+               (format == OUTPUT_RAW10)  ? 0x3FFu  :
+               (format == OUTPUT_RAW12)  ? 0xFFFu  : 0xFFu;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    template <uint32_t STAGES, typename TIn, uint32_t FORMAT> void AddDistortionRows(
+        const TIn*      pRd,
+        uint8_t*        pWr,
+        bool            enableSimd)
+    {
+        const size_t rowBytes = OutputRowBytes((OutputFormat)FORMAT);
+
+        // random stream of frame: a range per pixel, then values for the
+        // frame itself
+        m_frameRng.Seed(m_seedNoise, m_frame++);
+        const uint64_t frameCounter = (uint64_t)m_width * m_height << PIXEL_RANDS_SHIFT;
+
+        // lens blur of row Y needs lens distorted rows Y - radius thru
+        // Y + radius, which are kept in a ring buffer of rows so the frame is
+        // still read and written once
+        const int radius = (STAGES & STAGE_BLUR) ? m_blurRadius : 0;
+        for (int Y = 0; (Y < radius) && (Y < m_height); ++Y)
+        {
+            LensRow<STAGES>(pRd, Y, enableSimd);
+        }
+
+        for (int Y = 0; Y < m_height; ++Y)
+        {
+            uint8_t* pWrRow = pWr + Y * rowBytes;
+
+            NoiseOffsets(frameCounter, Y);
+
+            if (STAGES & STAGE_DF) // hot pixels of row, added in order of X
             {
-                uint32_t value;
+                m_pHot    = m_pDF->hot.data() + m_pDF->hotRows[Y];
+                m_pHotEnd = m_pDF->hot.data() + m_pDF->hotRows[Y + 1];
+            }
 
-                // lens distortion
-                if (enableLensDist)
+            if (STAGES & STAGE_BLUR)
+            {
+                if (Y + radius < m_height) { LensRow<STAGES>(pRd, Y + radius, enableSimd); }
+                BlurRow(Y, enableSimd);
+                FinishRow<STAGES, FORMAT>(m_blurOut.data(), pWrRow, Y, enableSimd);
+            }
+            else // no blur: all stages fused in a single loop
+            {
+                int X = 0; // first pixel left for the scalar kernel
+#if defined(__AVX2__)
+                if (enableSimd)
                 {
-                    int rd = r * m_lensDistLUT[iradius] / 256 + heightDiv2;
-                    int cd = c * m_lensDistLUT[iradius] / 256 + widthDiv2;
-                    if ((0 <= rd) && (rd < m_height) && // image boundry check
-                        (0 <= cd) && (cd < m_width)    )
-                    {
-                        // TODO: bilinear interp: Make rd, cd and lensDistLut Fixedpoint
-                        value = pRd[rd * m_width + cd]; // nearest neighbor interp
-                    }
-                    else
+                    for (; X + 8 <= m_width; X += 8)
                     {
-                        value = 0; // value for out of bounds
+                        FinishAVX2<STAGES, FORMAT>(LensAVX2<STAGES>(pRd, Y, X), pWrRow, Y, X);
                     }
                 }
-                else // else lens distortion disabled
+#endif
+                for (; X < m_width; ++X)
                 {
-                    value = *pRd++;
+                    StorePixel<FORMAT>(pWrRow, X, FinishScalar<STAGES, FORMAT>(LensScalar<STAGES>(pRd, Y, X), Y, X));
                 }
+            }
+        }
+    }
 
-                // TODO: lens blur goes here (or absorb it into lens
-                // distortion interpolation).  A 3x3 filter via FIFO might work.
+    // Dark frame as a dense base of small values (mean 2 at 60C) plus sparse
+    // hot pixels added to it, so costs about 1 byte per pixel rather than 4
+    struct HotPixel
+    {
+        uint16_t X;
+        uint16_t value;
+    };
+    struct SparseFrame
+    {
+        std::vector<uint8_t>  base;
+        std::vector<HotPixel> hot;     // sorted by row, then X
+        std::vector<int32_t>  hotRows; // index of first hot pixel of each row, then end
+    };
 
-                // relative illumination (aka lens vignetting)
-                value = (value * m_relativeIllumLUT[iradius]) >> 8;
+    ////////////////////////////////////////////////////////////////////////////
+    // Dark frame pixel value * scale, rounded
+    static inline uint32_t ScaleDF(uint32_t value, float scale)
+    {
+        return (uint32_t)(int32_t)(value * scale + 0.5f);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // df = D60 * scale. The dense base is scaled in one pass, saturating to 8
+    // bits, then hot pixels are scaled in a second. If the largest base value
+    // saturates (very hot sensor) the second pass also moves the excess of
+    // saturated base pixels to hot pixels.
+    void ScaleDarkFrame(float scale, SparseFrame& df) const
+    {
+        const uint8_t* pBase60 = m_df60.base.data();
+        const size_t   count   = m_df60.base.size();
+        df.base.resize(count);
+        uint8_t* pBase = df.base.data();
 
-                // add dark frame
-                if (enableDF) { value += *pDF++; }
+        size_t ii = 0;
+#if defined(__AVX2__)
+        const __m256 scale8 = _mm256_set1_ps(scale);
+        const __m256 half   = _mm256_set1_ps(0.5f);
+        for (; ii + 8 <= count; ii += 8)
+        {
+            const __m256  value  = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(pBase60 + ii))));
+            const __m256i scaled = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(value, scale8), half));
+            const __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(scaled), _mm256_extracti128_si256(scaled, 1));
+            _mm_storel_epi64((__m128i*)(pBase + ii), _mm_packus_epi16(packed, packed)); // saturate
+        }
+#endif
+        for (; ii < count; ++ii) { pBase[ii] = (uint8_t)std::min(ScaleDF(pBase60[ii], scale), 255u); }
 
-                // add Poisson noise, must be done AFTER adding dark
-                // frame (otherwise in the absense of a scene (e.g. lens covered)
-                // output would be dark frame rather than noisy dark frame)
-                if (value < 256u) // if LUT can be used...
+        const bool saturated = ScaleDF(m_df60BaseMax, scale) > 255u;
+        df.hot.clear();
+        df.hotRows.resize(m_height + 1);
+        for (int Y = 0; Y < m_height; ++Y)
+        {
+            df.hotRows[Y] = (int32_t)df.hot.size();
+            const uint8_t*  pRow60  = pBase60 + Y * m_width;
+            const HotPixel* pHot    = m_df60.hot.data() + m_df60.hotRows[Y];
+            const HotPixel* pHotEnd = m_df60.hot.data() + m_df60.hotRows[Y + 1];
+            int X = 0; // next base pixel to check for saturation
+            for (;;)
+            {
+                const int XEnd = (pHot != pHotEnd) ? pHot->X : m_width;
+                for (; saturated && (X < XEnd); ++X)
                 {
-                    value = m_noiseLUT[value * 256 + m_noiseIdx];
-                    m_noiseIdx++; // increment index with intentional roll-over
+                    const uint32_t value = ScaleDF(pRow60[X], scale);
+                    if (value > 255u)
+                    {
+                        const HotPixel excess = { (uint16_t)X, (uint16_t)std::min(value - 255u, 0xFFFFu) };
+                        df.hot.push_back(excess);
+                    }
                 }
-                else              // else generate Poisson sample on-the-fly
+                if (pHot == pHotEnd) { break; }
+
+                const HotPixel hot = { pHot->X, (uint16_t)std::min(ScaleDF(pHot->value, scale), 0xFFFFu) };
+                df.hot.push_back(hot);
+                X = pHot->X + 1; // base of hot pixels is 0
+                ++pHot;
+            }
+        }
+        df.hotRows[m_height] = (int32_t)df.hot.size();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Add Poisson noise to a pixel. Must be done AFTER adding dark frame
+    // (otherwise in the absense of a scene (e.g. lens covered) output would be
+    // dark frame rather than noisy dark frame).
+    // col is the noise LUT column of the pixel (see NoiseOffsets()).
+    inline uint32_t AddNoise(uint32_t value, int idx, uint32_t col)
+    {
+        if (value < 256u) // if LUT can be used...
+        {
+            value = m_noiseLUT[value * 256 + col];
+        }
+        else if (value < m_noiseLUTMax) // else if quantile LUT can be used...
+        {
+            // Note: can't go negative as z > -sqrt(256)
+            const int32_t z = m_noiseQuantiles[(value >> NOISE_BUCKET_SHIFT) * 256 + col];
+            // Note: downshift of a signed value is implementation defined so
+            // bias the rounded product positive (as does the AVX2 kernel)
+            const uint32_t biased = (uint32_t)(m_noiseSqrt[value] * z + NOISE_ROUND + NOISE_BIAS);
+            value += (biased >> NOISE_FBITS) - (NOISE_BIAS >> NOISE_FBITS);
+        }
+        else // else generate Poisson sample on-the-fly
+        {
+            Rng rng = PixelRng(idx);
+            value = randp((float)value, rng);
+        }
+        return value;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Set the random noise LUT column offsets and strides of row Y. Pixel ii
+    // of each block of NOISE_BLOCK pixels reads LUT column
+    //     (offset + ii * stride) & 0xFF
+    // with a random offset and odd stride per block, so pixels of a block get
+    // distinct LUT samples, pixels of other blocks and rows are uncorrelated
+    // (a single offset per frame repeats the same samples every 256 pixels,
+    // which shows as diagonal stripes) and neighbours do not inherit the
+    // correlation of adjacent samples of the 256 sample LUT rows.
+    // An 8 pixel SIMD vector never spans blocks.
+    inline void NoiseOffsets(uint64_t frameCounter, int Y)
+    {
+        const int numRands = (int)m_noiseOffsets.size() / 4;
+        const uint64_t counter = frameCounter + (uint64_t)Y * numRands;
+        for (int ii = 0; ii < numRands; ++ii)
+        {
+            uint64_t bits = m_frameRng.At(counter + ii); // 4 blocks
+            for (int jj = 0; jj < 4; ++jj, bits >>= 16)
+            {
+                m_noiseOffsets[ii * 4 + jj] = (uint8_t)bits;
+                m_noiseStrides[ii * 4 + jj] = (uint8_t)(bits >> 8) | 1u;
+            }
+        }
+    }
+
+    inline uint32_t NoiseCol(int X) const
+    {
+        const int block = X >> NOISE_BLOCK_SHIFT;
+        return (m_noiseOffsets[block] + (X & (NOISE_BLOCK - 1)) * m_noiseStrides[block]) & 0xFFu;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Fill a row of the noise quantile LUT with the Poisson(lam) quantiles at
+    // probabilities (ii + 0.5) / 256, standardized and in random order
+    static void InitNoiseQuantiles(float lam, int16_t* pRow, Rng& rng)
+    {
+        const double sd = sqrt((double)lam);
+        int32_t k = (int32_t)(lam - 10.0 * sd); // CDF below this is negligible
+        if (k < 0) { k = 0; }
+        double cdf = exp(-lam + k * log((double)lam) - lgamma(k + 1.0));
+        for (int ii = 0; ii < 256; ++ii)
+        {
+            const double p = (ii + 0.5) / 256;
+            while (cdf < p)
+            {
+                ++k;
+                cdf += exp(-lam + k * log((double)lam) - lgamma(k + 1.0));
+            }
+            pRow[ii] = (int16_t)lround((k - lam) / sd * (1 << NOISE_Z_FBITS));
+        }
+
+        // shuffle so consecutive pixels get uncorrelated noise
+        for (int ii = 255; ii > 0; --ii)
+        {
+            const int jj = (int)(rng.Next32() % (ii + 1));
+            const int16_t tmp = pRow[ii];
+            pRow[ii] = pRow[jj];
+            pRow[jj] = tmp;
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Random values of pixel idx of the current frame
+    inline Rng PixelRng(int idx) const
+    {
+        Rng rng = m_frameRng;
+        rng.Seek((uint64_t)idx << PIXEL_RANDS_SHIFT);
+        return rng;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Compress pixel to 8 bits, or clip it to the bits of the output format
+    template <uint32_t STAGES, uint32_t FORMAT> inline uint32_t Compress(uint32_t value) const
+    {
+        // TODO: SPAD nonlinearity to convert from photons to counts.
+        // (but PWL can linearize and compress so can probably skip)
+        // This could be implemented as a linearly interpolated LUT.
+
+        // PWL compression from 12-bits to 8-bits
+        if (STAGES & STAGE_PWL)
+        {
+            if (value > 4095) { value = 4095; } // clip to 12 bits
+            value = m_pwlLUT[value];
+        }
+
+        if (value > OutputMax(FORMAT)) { value = OutputMax(FORMAT); } // clip to output bits
+        return value;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Write pixel X of output row pWrRow in the output format. Packed formats
+    // share bytes between pixels so only update the bits of pixel X.
+    template <uint32_t FORMAT> inline void StorePixel(uint8_t* pWrRow, int X, uint32_t value) const
+    {
+        if (FORMAT == OUTPUT_BGRX)
+        {
+            ((uint32_t*)pWrRow)[X] = m_byte2rgbLUT[value]; // convert to format needed by GdiWindow
+        }
+        else if (FORMAT == OUTPUT_GRAY16)
+        {
+            ((uint16_t*)pWrRow)[X] = (uint16_t)value;
+        }
+        else if (FORMAT == OUTPUT_RAW10)
+        {
+            uint8_t*  p     = pWrRow + (X >> 2) * 5;
+            const int shift = 2 * (X & 3);
+            p[X & 3] = (uint8_t)(value >> 2);
+            p[4]     = (uint8_t)((p[4] & ~(0x3u << shift)) | ((value & 0x3u) << shift));
+        }
+        else if (FORMAT == OUTPUT_RAW12)
+        {
+            uint8_t*  p     = pWrRow + (X >> 1) * 3;
+            const int shift = 4 * (X & 1);
+            p[X & 1] = (uint8_t)(value >> 4);
+            p[2]     = (uint8_t)((p[2] & ~(0xFu << shift)) | ((value & 0xFu) << shift));
+        }
+        else
+        {
+            pWrRow[X] = (uint8_t)value;
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Compute the per pixel source index, bilinear weight and vignetting gain
+    // tables from the radius indexed LUTs, so AddDistortion() only has to look
+    // them up
+    void InitRemap(void)
+    {
+        assert((m_width >= 2) && (m_height >= 2)); // for bilinear
+        const int widthDiv2  = m_width  / 2;
+        const int heightDiv2 = m_height / 2;
+        m_srcIdx.resize(m_width * m_height);
+        m_srcIdxBilinear.resize(m_width * m_height);
+        m_weights.resize(m_width * m_height);
+        m_illum.resize(m_width * m_height);
+
+        int32_t*  pSrcIdx   = m_srcIdx.data();
+        int32_t*  pSrcIdxBl = m_srcIdxBilinear.data();
+        uint32_t* pWeights  = m_weights.data();
+        uint8_t*  pIllum    = m_illum.data();
+        for (int r = -heightDiv2; r < heightDiv2; ++r)
+        {
+            // set up radius for first pixel of this row
+            // Note: due to cast to int: iradius * iradius <= radius2
+            int radius2 = r * r + widthDiv2 * widthDiv2;
+            int iradius = (int)sqrtf((float)radius2); // "integer radius"
+
+            for (int c = -widthDiv2; c < widthDiv2; ++c)
+            {
+                // lens distortion
+                const int32_t scale = (int32_t)m_lensDistLUT[iradius];
+                int rd = r * scale / (1 << LENS_FBITS) + heightDiv2;
+                int cd = c * scale / (1 << LENS_FBITS) + widthDiv2;
+                if ((0 <= rd) && (rd < m_height) && // image boundry check
+                    (0 <= cd) && (cd < m_width)    )
                 {
-                    PoissonDist<uint32_t>((float)value, 1u, &value);
+                    *pSrcIdx++ = rd * m_width + cd; // nearest neighbor interp
+                }
+                else
+                {
+                    *pSrcIdx++ = SRC_OUT_OF_BOUNDS;
                 }
 
-                // TODO: SPAD nonlinearity to convert from photons to counts.
-                // (but PWL can linearize and compress so can probably skip)
-                // This could be implemented as a linearly interpolated LUT.
-
-                // PWL compression from 12-bits to 8-bits
-                if (enablePWL)
+                // bilinear interp: source position with LENS_FBITS fractional
+                // bits, which must lie within the centers of the edge pixels
+                const int32_t rdFix = r * scale + (heightDiv2 << LENS_FBITS);
+                const int32_t cdFix = c * scale + ( widthDiv2 << LENS_FBITS);
+                if ((0 <= rdFix) && (rdFix <= ((m_height - 1) << LENS_FBITS)) &&
+                    (0 <= cdFix) && (cdFix <= (( m_width - 1) << LENS_FBITS))    )
+                {
+                    // top left of the 2x2 pixels and Q8 weights of bottom right
+                    int y0 = rdFix >> LENS_FBITS;
+                    int x0 = cdFix >> LENS_FBITS;
+                    uint32_t fy = (rdFix >> (LENS_FBITS - 8)) & 0xFFu;
+                    uint32_t fx = (cdFix >> (LENS_FBITS - 8)) & 0xFFu;
+                    if (y0 == m_height - 1) { y0--; fy = 256; } // keep 2x2 in bounds
+                    if (x0 ==  m_width - 1) { x0--; fx = 256; }
+                    *pSrcIdxBl++ = y0 * m_width + x0;
+                    *pWeights++  = (fy << 16) | fx;
+                }
+                else
                 {
-                    if (value > 4095) { value = 4095; } // clip to 12 bits
-                    value = m_pwlLUT[value];
+                    *pSrcIdxBl++ = SRC_OUT_OF_BOUNDS;
+                    *pWeights++  = 0;
                 }
 
-                if (value > 255u) { value = 255u; } // clip to 8 bits
-                *pWr++ = m_byte2rgbLUT[value]; // convert to format needed by GdiWindow
+                // relative illumination (aka lens vignetting)
+                *pIllum++ = m_relativeIllumLUT[iradius];
 
                 // update iradius for next column (c + 1):
                 // we're at c^2 and need to get to (c+1)^2
@@ -237,28 +858,601 @@ public:
                 radius2 += 2 * c + 1; // compute radius^2 for (c+1)
 
                 // Adjust iradius so that: iradius^2 <= radius2
-                // TODO: 2 mults can be replaced with shifts/adds (see RadiusRaster unit test)
                 if (iradius * iradius < radius2) { ++iradius; } // avoid sqrt()
                 if (iradius * iradius > radius2) { --iradius; } // avoid sqrt()
             }
         }
     }
 
-private:
+    ////////////////////////////////////////////////////////////////////////////
+    // Lens distortion of pixel X of output row Y
+    template <uint32_t STAGES, typename TIn> inline uint32_t LensScalar(
+        const TIn*      pRd,            // input rendered frame
+        int             Y,
+        int             X) const
+    {
+        const int idx = Y * m_width + X;
+        if ((STAGES & STAGE_LENS_DIST) && (STAGES & STAGE_BILINEAR))
+        {
+            const int32_t srcIdx = m_srcIdxBilinear[idx];
+            if (srcIdx == SRC_OUT_OF_BOUNDS) { return 0; }
+
+            const uint32_t fx = m_weights[idx] & 0x1FFu;
+            const uint32_t fy = m_weights[idx] >> 16;
+            const TIn* p = pRd + srcIdx;
+            const uint32_t top = (p[0]       * (256 - fx) + p[1]           * fx + 128) >> 8;
+            const uint32_t bot = (p[m_width] * (256 - fx) + p[m_width + 1] * fx + 128) >> 8;
+            return (top * (256 - fy) + bot * fy + 128) >> 8;
+        }
+        else if (STAGES & STAGE_LENS_DIST)
+        {
+            const int32_t srcIdx = m_srcIdx[idx];
+            return (srcIdx != SRC_OUT_OF_BOUNDS) ? pRd[srcIdx] : 0; // nearest
+        }
+        return pRd[idx]; // lens distortion disabled
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Stages after lens blur for pixel X of output row Y, returns output pixel
+    template <uint32_t STAGES, uint32_t FORMAT> inline uint32_t FinishScalar(
+        uint32_t        value,
+        int             Y,
+        int             X)
+    {
+        const int idx = Y * m_width + X;
+
+        // relative illumination (aka lens vignetting)
+        value = (value * m_illum[idx]) >> 8;
+
+        // add dark frame
+        if (STAGES & STAGE_DF)
+        {
+            value += m_pDF->base[idx];
+            if ((m_pHot != m_pHotEnd) && (m_pHot->X == X)) { value += m_pHot++->value; }
+        }
+
+        value = AddNoise(value, idx, NoiseCol(X));
+
+        return Compress<STAGES, FORMAT>(value);
+    }
+
+#if defined(__AVX2__)
+    ////////////////////////////////////////////////////////////////////////////
+    // AVX2 versions of LensScalar() and FinishScalar() for pixels X thru X + 7,
+    // with the LUT stages done by gathers.
+    // Note: SSE2 has no gather so there are no SSE2 kernels.
+    template <uint32_t STAGES, typename TIn> inline __m256i LensAVX2(
+        const TIn*      pRd,            // input rendered frame
+        int             Y,
+        int             X) const
+    {
+        const int idx = Y * m_width + X;
+        if ((STAGES & STAGE_LENS_DIST) && (STAGES & STAGE_BILINEAR))
+        {
+            // 2x2 source pixels, out of bounds lanes are zero
+            const __m256i srcIdx = _mm256_loadu_si256((const __m256i*)(m_srcIdxBilinear.data() + idx));
+            const __m256i inside = _mm256_cmpgt_epi32(srcIdx, _mm256_set1_epi32(SRC_OUT_OF_BOUNDS));
+            const __m256i idxB   = _mm256_add_epi32(srcIdx, _mm256_set1_epi32(m_width));
+            const __m256i one    = _mm256_set1_epi32(1);
+            const __m256i p00 = GatherPixels(pRd, srcIdx, inside);
+            const __m256i p01 = GatherPixels(pRd, _mm256_add_epi32(srcIdx, one), inside);
+            const __m256i p10 = GatherPixels(pRd, idxB, inside);
+            const __m256i p11 = GatherPixels(pRd, _mm256_add_epi32(idxB, one), inside);
+
+            const __m256i weights = _mm256_loadu_si256((const __m256i*)(m_weights.data() + idx));
+            const __m256i fx   = _mm256_and_si256(weights, _mm256_set1_epi32(0x1FF));
+            const __m256i fy   = _mm256_srli_epi32(weights, 16);
+            const __m256i v256 = _mm256_set1_epi32(256);
+            const __m256i v128 = _mm256_set1_epi32(128);
+            const __m256i fx1  = _mm256_sub_epi32(v256, fx);
+            const __m256i fy1  = _mm256_sub_epi32(v256, fy);
+            const __m256i top  = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(
+                _mm256_mullo_epi32(p00, fx1), _mm256_mullo_epi32(p01, fx)), v128), 8);
+            const __m256i bot  = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(
+                _mm256_mullo_epi32(p10, fx1), _mm256_mullo_epi32(p11, fx)), v128), 8);
+            return _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(
+                _mm256_mullo_epi32(top, fy1), _mm256_mullo_epi32(bot, fy)), v128), 8);
+        }
+        else if (STAGES & STAGE_LENS_DIST)
+        {
+            const __m256i srcIdx = _mm256_loadu_si256((const __m256i*)(m_srcIdx.data() + idx));
+            const __m256i inside = _mm256_cmpgt_epi32(srcIdx, _mm256_set1_epi32(SRC_OUT_OF_BOUNDS));
+            return GatherPixels(pRd, srcIdx, inside); // nearest
+        }
+        return LoadPixels(pRd + idx);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Load 8 rendered pixels
+    static inline __m256i LoadPixels(const uint32_t* p)
+    {
+        return _mm256_loadu_si256((const __m256i*)p);
+    }
+    static inline __m256i LoadPixels(const uint16_t* p)
+    {
+        return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p));
+    }
+    static inline __m256i LoadPixels(const uint8_t* p)
+    {
+        return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p));
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Gather rendered pixels at srcIdx of lanes in mask, other lanes are zero
+    template <typename TIn> static inline __m256i GatherPixels(
+        const TIn* pRd,
+        __m256i    srcIdx,
+        __m256i    mask)
+    {
+        const __m256i value = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+            (const int*)pRd, srcIdx, mask, sizeof(TIn));
+        if (sizeof(TIn) == 4) { return value; }
+        return _mm256_and_si256(value, _mm256_set1_epi32((int)(0xFFFFFFFFu >> (32 - 8 * sizeof(TIn)))));
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    template <uint32_t STAGES, uint32_t FORMAT> inline void FinishAVX2(
+        __m256i         value,
+        uint8_t*        pWrRow,         // output row
+        int             Y,
+        int             X)
+    {
+        const int idx = Y * m_width + X;
+        const __m256i zero   = _mm256_setzero_si256();
+        const __m256i lane   = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i mask8  = _mm256_set1_epi32(0xFF);
+        const __m256i mask16 = _mm256_set1_epi32(0xFFFF);
+
+        // relative illumination (aka lens vignetting)
+        const __m256i illum = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(m_illum.data() + idx)));
+        value = _mm256_srli_epi32(_mm256_mullo_epi32(value, illum), 8);
+
+        // add dark frame
+        if (STAGES & STAGE_DF)
+        {
+            value = _mm256_add_epi32(value, _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(m_pDF->base.data() + idx))));
+            for (; (m_pHot != m_pHotEnd) && (m_pHot->X < X + 8); ++m_pHot)
+            {
+                const __m256i isHot = _mm256_cmpeq_epi32(lane, _mm256_set1_epi32(m_pHot->X - X));
+                value = _mm256_add_epi32(value, _mm256_and_si256(isHot, _mm256_set1_epi32(m_pHot->value)));
+            }
+        }
+
+        // add Poisson noise from LUT to pixels < 256
+        const __m256i small = _mm256_cmpeq_epi32(_mm256_srli_epi32(value, 8), zero);
+        const __m256i col   = _mm256_and_si256(_mm256_add_epi32(_mm256_set1_epi32(NoiseCol(X)),
+            _mm256_mullo_epi32(lane, _mm256_set1_epi32(m_noiseStrides[X >> NOISE_BLOCK_SHIFT]))), mask8);
+        const __m256i noisy = _mm256_and_si256(mask16, _mm256_mask_i32gather_epi32(zero,
+            (const int*)m_noiseLUT.data(), _mm256_add_epi32(_mm256_slli_epi32(value, 8), col), small, 2));
+
+        // and from quantile LUT to pixels < m_noiseLUTMax
+        const __m256i mid   = _mm256_andnot_si256(small,
+            _mm256_cmpgt_epi32(_mm256_set1_epi32(m_noiseLUTMax), value));
+        const __m256i sd    = _mm256_and_si256(mask16, _mm256_mask_i32gather_epi32(zero,
+            (const int*)m_noiseSqrt.data(), value, mid, 2));
+        const __m256i row   = _mm256_slli_epi32(_mm256_srli_epi32(value, NOISE_BUCKET_SHIFT), 8);
+        const __m256i z     = _mm256_srai_epi32(_mm256_slli_epi32(_mm256_mask_i32gather_epi32(zero,
+            (const int*)m_noiseQuantiles.data(), _mm256_add_epi32(row, col), mid, 2), 16), 16);
+        const __m256i noisyMid = _mm256_sub_epi32(_mm256_add_epi32(value, _mm256_srli_epi32(_mm256_add_epi32(
+            _mm256_mullo_epi32(sd, z), _mm256_set1_epi32(NOISE_ROUND + NOISE_BIAS)), NOISE_FBITS)),
+            _mm256_set1_epi32(NOISE_BIAS >> NOISE_FBITS));
+
+        if (_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_or_si256(small, mid))) != 0xFF)
+        {
+            // generate Poisson samples of larger pixels on-the-fly, from the
+            // same per pixel random streams as the scalar kernel
+            alignas(32) uint32_t lanes[8];
+            _mm256_store_si256((__m256i*)lanes, value);
+            for (int ii = 0; ii < 8; ++ii)
+            {
+                if (lanes[ii] >= m_noiseLUTMax)
+                {
+                    Rng rng = PixelRng(idx + ii);
+                    lanes[ii] = randp((float)lanes[ii], rng);
+                }
+            }
+            value = _mm256_load_si256((const __m256i*)lanes);
+        }
+        value = _mm256_blendv_epi8(value, noisyMid, mid);
+        value = _mm256_blendv_epi8(value, noisy, small);
+
+        // PWL compression from 12-bits to 8-bits
+        if (STAGES & STAGE_PWL)
+        {
+            value = _mm256_min_epu32(value, _mm256_set1_epi32(4095));
+            value = _mm256_and_si256(mask8,
+                _mm256_i32gather_epi32((const int*)m_pwlLUT.data(), value, 1));
+        }
+
+        // clip to output bits
+        value = _mm256_min_epu32(value, _mm256_set1_epi32(OutputMax(FORMAT)));
+        StorePixels<FORMAT>(pWrRow, X, value);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // AVX2 version of StorePixel() for pixels X thru X + 7, X is a multiple
+    // of 8 so packed formats start at a byte
+    template <uint32_t FORMAT> inline void StorePixels(uint8_t* pWrRow, int X, __m256i value) const
+    {
+        if (FORMAT == OUTPUT_BGRX)
+        {
+            value = _mm256_i32gather_epi32((const int*)m_byte2rgbLUT.data(), value, 4);
+            _mm256_storeu_si256((__m256i*)(pWrRow + X * 4), value);
+            return;
+        }
+
+        // 8 pixels of 16 bits
+        const __m128i pix16 = _mm_packus_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+        if (FORMAT == OUTPUT_GRAY16)
+        {
+            _mm_storeu_si128((__m128i*)(pWrRow + X * 2), pix16);
+        }
+        else if (FORMAT == OUTPUT_RAW10)
+        {
+            // low 2 bits of each group of 4 pixels in the low byte of 64 bits
+            __m128i lsbs = _mm_and_si128(pix16, _mm_set1_epi16(0x3));
+            lsbs = _mm_or_si128(lsbs, _mm_srli_epi32(lsbs, 14));
+            lsbs = _mm_and_si128(_mm_or_si128(lsbs, _mm_srli_epi64(lsbs, 28)), _mm_set_epi32(0, 0xFF, 0, 0xFF));
+
+            // bytes 0-7 are the high 8 bits, bytes 8 and 12 the low bits
+            const __m128i bytes = _mm_packus_epi16(_mm_srli_epi16(pix16, 2), lsbs);
+            const __m128i raw10 = _mm_shuffle_epi8(bytes,
+                _mm_setr_epi8(0, 1, 2, 3, 8, 4, 5, 6, 7, 12, -1, -1, -1, -1, -1, -1));
+            uint8_t* p = pWrRow + X / 4 * 5;
+            _mm_storel_epi64((__m128i*)p, raw10);
+            const uint16_t tail = (uint16_t)_mm_extract_epi16(raw10, 4);
+            memcpy(p + 8, &tail, 2);
+        }
+        else if (FORMAT == OUTPUT_RAW12)
+        {
+            // bytes of each pair of pixels in the low 3 bytes of 32 bits
+            const __m128i high  = _mm_and_si128(_mm_srli_epi16(pix16, 4), _mm_set1_epi16(0xFF));
+            const __m128i low   = _mm_and_si128(pix16, _mm_set1_epi16(0xF));
+            const __m128i pairs = _mm_or_si128(_mm_or_si128(
+                _mm_and_si128(high, _mm_set1_epi32(0xFF)), _mm_srli_epi32(high, 8)),
+                _mm_slli_epi32(_mm_or_si128(_mm_and_si128(low, _mm_set1_epi32(0xF)), _mm_srli_epi32(low, 12)), 16));
+            const __m128i raw12 = _mm_shuffle_epi8(pairs,
+                _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+            uint8_t* p = pWrRow + X / 2 * 3;
+            _mm_storel_epi64((__m128i*)p, raw12);
+            const uint32_t tail = (uint32_t)_mm_extract_epi32(raw12, 2);
+            memcpy(p + 8, &tail, 4);
+        }
+        else
+        {
+            _mm_storel_epi64((__m128i*)(pWrRow + X), _mm_packus_epi16(pix16, pix16));
+        }
+    }
+#endif // #if defined(__AVX2__)
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Lens distort row Y into the lens blur ring buffer, including the
+    // replicated edge pixels the blur reads past the ends of the row
+    template <uint32_t STAGES, typename TIn> void LensRow(
+        const TIn*      pRd,            // input rendered frame
+        int             Y,
+        bool            enableSimd)
+    {
+        uint32_t* pRow = BlurRingRow(Y);
+
+        int X = 0;
+#if defined(__AVX2__)
+        if (enableSimd)
+        {
+            for (; X + 8 <= m_width; X += 8)
+            {
+                _mm256_storeu_si256((__m256i*)(pRow + X), LensAVX2<STAGES>(pRd, Y, X));
+            }
+        }
+#else
+        (void)enableSimd;
+#endif
+        for (; X < m_width; ++X) { pRow[X] = LensScalar<STAGES>(pRd, Y, X); }
+
+        PadRow(pRow);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Stages after lens blur for row Y, pIn is the blurred row
+    template <uint32_t STAGES, uint32_t FORMAT> void FinishRow(
+        const uint32_t* pIn,
+        uint8_t*        pWrRow,         // output row
+        int             Y,
+        bool            enableSimd)
+    {
+        int X = 0;
+#if defined(__AVX2__)
+        if (enableSimd)
+        {
+            for (; X + 8 <= m_width; X += 8)
+            {
+                FinishAVX2<STAGES, FORMAT>(_mm256_loadu_si256((const __m256i*)(pIn + X)), pWrRow, Y, X);
+            }
+        }
+#else
+        (void)enableSimd;
+#endif
+        for (; X < m_width; ++X) { StorePixel<FORMAT>(pWrRow, X, FinishScalar<STAGES, FORMAT>(pIn[X], Y, X)); }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Lens blur row Y from the lens distorted rows in the ring buffer into
+    // m_blurOut. Rows above and below the frame replicate the edge rows.
+    void BlurRow(int Y, bool enableSimd)
+    {
+        const int radius  = m_blurRadius;
+        const int numTaps = 2 * radius + 1;
+
+        const uint32_t* rows[2 * MAX_BLUR_RADIUS + 1];
+        for (int ii = 0; ii < numTaps; ++ii)
+        {
+            int YSrc = Y + ii - radius;
+            if (YSrc < 0)         { YSrc = 0; }
+            if (YSrc >= m_height) { YSrc = m_height - 1; }
+            rows[ii] = BlurRingRow(YSrc);
+        }
+
+        // one radial zone at a time, so its kernel is loaded once per run
+        const BlurRun* pRun    = m_blurRuns.data() + m_blurRowRuns[Y];
+        const BlurRun* pRunEnd = m_blurRuns.data() + m_blurRowRuns[Y + 1];
+        if (m_blurSeparable)
+        {
+            // vertical pass of the run plus the radius pixels either side of
+            // it read by the horizontal pass (padding of the ring buffer rows
+            // makes pixels left and right of the frame replicate the edges)
+            uint32_t*       pTmp     = m_blurTmp.data() + radius;
+            const uint32_t* pTmpLeft = m_blurTmp.data();
+            for (; pRun < pRunEnd; ++pRun)
+            {
+                const int zoneOffset = pRun->zone * numTaps;
+                Convolve(rows, numTaps, m_blurKernelY.data() + zoneOffset, 1,
+                         pTmp, pRun->XStart - radius, pRun->XEnd + radius, enableSimd);
+                Convolve(&pTmpLeft, 1, m_blurKernelX.data() + zoneOffset, numTaps,
+                         m_blurOut.data(), pRun->XStart, pRun->XEnd, enableSimd);
+            }
+        }
+        else
+        {
+            for (int ii = 0; ii < numTaps; ++ii) { rows[ii] -= radius; }
+            for (; pRun < pRunEnd; ++pRun)
+            {
+                Convolve(rows, numTaps, m_blurKernel2D.data() + pRun->zone * numTaps * numTaps, numTaps,
+                         m_blurOut.data(), pRun->XStart, pRun->XEnd, enableSimd);
+            }
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Convolve pixels XStart thru XEnd - 1 of a row:
+    //     pOut[X] = sum of taps[j * numCols + i] * rows[j][X + i]
+    // rounded to an integer (taps have BLUR_FBITS fractional bits)
+    void Convolve(
+        const uint32_t* const* rows,
+        int                    numRows,
+        const uint32_t*        taps,
+        int                    numCols,
+        uint32_t*              pOut,
+        int                    XStart,
+        int                    XEnd,
+        bool                   enableSimd) const
+    {
+        const uint32_t half = 1u << (BLUR_FBITS - 1);
+        const int numTaps = numRows * numCols;
+
+        int X = XStart;
+#if defined(__AVX2__)
+        if (enableSimd && (X + 8 <= XEnd))
+        {
+            // broadcast taps once for the whole run
+            __m256i tapsV[MAX_BLUR_TAPS];
+            for (int ii = 0; ii < numTaps; ++ii) { tapsV[ii] = _mm256_set1_epi32(taps[ii]); }
+
+            for (; X + 8 <= XEnd; X += 8)
+            {
+                __m256i acc = _mm256_set1_epi32(half);
+                for (int jj = 0; jj < numRows; ++jj)
+                {
+                    for (int ii = 0; ii < numCols; ++ii)
+                    {
+                        const __m256i in = _mm256_loadu_si256((const __m256i*)(rows[jj] + X + ii));
+                        acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(in, tapsV[jj * numCols + ii]));
+                    }
+                }
+                _mm256_storeu_si256((__m256i*)(pOut + X), _mm256_srli_epi32(acc, BLUR_FBITS));
+            }
+        }
+#else
+        (void)enableSimd;
+        (void)numTaps;
+#endif
+        for (; X < XEnd; ++X)
+        {
+            uint32_t acc = half;
+            for (int jj = 0; jj < numRows; ++jj)
+            {
+                for (int ii = 0; ii < numCols; ++ii)
+                {
+                    acc += rows[jj][X + ii] * taps[jj * numCols + ii];
+                }
+            }
+            pOut[X] = acc >> BLUR_FBITS;
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Replicate the first and last pixels of a row into its blur radius pixels
+    // of padding on either side
+    inline void PadRow(uint32_t* pRow) const
+    {
+        for (int ii = 1; ii <= m_blurRadius; ++ii)
+        {
+            pRow[-ii]              = pRow[0];
+            pRow[m_width - 1 + ii] = pRow[m_width - 1];
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // First pixel of lens distorted row Y in the lens blur ring buffer
+    inline uint32_t* BlurRingRow(int Y)
+    {
+        const int numRows = 2 * m_blurRadius + 1;
+        const int stride  = m_width + 2 * m_blurRadius;
+        return m_blurRing.data() + (Y % numRows) * stride + m_blurRadius;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Size the lens blur buffers for a kernel radius and split each row into
+    // runs of pixels in the same radial zone
+    void InitBlur(int radius, bool separable, const int* zoneRadius, int numZones)
+    {
+        const int numTaps = 2 * radius + 1;
+        const int stride  = m_width + 2 * radius;
+        m_blurRadius    = radius;
+        m_blurSeparable = separable;
+        m_blurRing.assign((size_t)numTaps * stride, 0);
+        m_blurTmp.assign(stride, 0);
+        m_blurOut.assign(m_width, 0);
+
+        // zone of each radius, same radius as the other radius indexed LUTs
+        std::vector<uint8_t> zoneLUT(m_relativeIllumLUT.size());
+        int zone = 0;
+        for (int r = 0; r < (int)zoneLUT.size(); ++r)
+        {
+            while ((zone < numZones - 1) && (r >= zoneRadius[zone])) { ++zone; }
+            zoneLUT[r] = (uint8_t)zone;
+        }
+
+        const int widthDiv2  = m_width  / 2;
+        const int heightDiv2 = m_height / 2;
+        m_blurRuns.clear();
+        m_blurRowRuns.resize(m_height + 1);
+        for (int Y = 0; Y < m_height; ++Y)
+        {
+            m_blurRowRuns[Y] = (int32_t)m_blurRuns.size();
+            const int r = Y - heightDiv2;
+            for (int X = 0; X < m_width; ++X)
+            {
+                const int c = X - widthDiv2;
+                const int iradius = (int)sqrtf((float)(r * r + c * c));
+                const uint8_t pixelZone = zoneLUT[iradius];
+                if ((X == 0) || (m_blurRuns.back().zone != pixelZone))
+                {
+                    BlurRun run = { X, X, pixelZone };
+                    m_blurRuns.push_back(run);
+                }
+                m_blurRuns.back().XEnd++;
+            }
+        }
+        m_blurRowRuns[m_height] = (int32_t)m_blurRuns.size();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Convert a kernel to taps with BLUR_FBITS fractional bits that sum to
+    // exactly 1.0, so blur does not change the brightness of flat areas
+    static void QuantizeKernel(const float* kernel, int numTaps, uint32_t* taps)
+    {
+        float sum = 0.0f;
+        int largest = 0;
+        for (int ii = 0; ii < numTaps; ++ii)
+        {
+            assert(kernel[ii] >= 0.0f); // a PSF can't be negative
+            sum += kernel[ii];
+            if (kernel[ii] > kernel[largest]) { largest = ii; }
+        }
+        assert(sum > 0.0f);
+
+        uint32_t total = 0;
+        for (int ii = 0; ii < numTaps; ++ii)
+        {
+            taps[ii] = (uint32_t)(kernel[ii] / sum * (1 << BLUR_FBITS) + 0.5f); // round
+            total += taps[ii];
+        }
+        taps[largest] += (1u << BLUR_FBITS) - total; // rounding error to largest tap
+    }
+
+    // 32-bit gathers of 8 or 16-bit LUT entries read up to 3 bytes past the
+    // entry, so LUTs are padded by this many entries
+    static const int GATHER_PAD = 3;
+
     int32_t m_width;
     int32_t m_height;
 
-    std::vector<uint32_t> m_pDF60;
-    std::vector<uint32_t> m_pDF;
+    SparseFrame m_df60; // D60 of SetDarkFrame()
+    uint8_t     m_df60BaseMax;
+
+    // dark frames of SetDarkFrame()
+    struct DarkFrame
+    {
+        int32_t  tempQ;       // sensor temperature in 1 / DF_TEMP_STEPS degrees C
+        float    doubleTempC;
+        uint32_t expTimeUsec;
+        uint64_t lastUse;     // m_dfUse when last set
+        SparseFrame pixels;
+    };
+    std::vector<DarkFrame> m_dfCache;     // least recently used is replaced
+    size_t                 m_dfCacheSize; // max dark frames cached
+    uint64_t               m_dfUse;       // counts SetDarkFrame() calls
+    const SparseFrame*     m_pDF;         // current dark frame, in m_dfCache
+    const HotPixel*        m_pHot;        // next hot pixel of current row
+    const HotPixel*        m_pHotEnd;     // end of hot pixels of current row
 
     // LUTs that take radius as input
-    std::vector<uint16_t> m_lensDistLUT;      //  barrel/pincushion distortion
+    static const int      LENS_FBITS = 16;    // fractional bits of m_lensDistLUT
+    std::vector<uint32_t> m_lensDistLUT;      //  barrel/pincushion distortion
     std::vector<uint8_t>  m_relativeIllumLUT; // Q8 fractional multiplier
 
+    // Per pixel tables computed from radius LUTs by InitRemap()
+    static const int32_t  SRC_OUT_OF_BOUNDS = -1;
+    std::vector<int32_t>  m_srcIdx;         // index of distorted source pixel
+    std::vector<int32_t>  m_srcIdxBilinear; // index of top left of 2x2 source pixels
+    std::vector<uint32_t> m_weights;        // Q8 bilinear weights of bottom right
+                                            // pixels (0 to 256), X | (Y << 16)
+    std::vector<uint8_t>  m_illum;          // relative illumination (Q8)
+
+    // Lens blur
+    static const int      BLUR_FBITS = 10;  // fractional bits of kernel taps
+    static const int      MAX_BLUR_TAPS = (2 * MAX_BLUR_RADIUS_2D + 1) * (2 * MAX_BLUR_RADIUS_2D + 1);
+    static_assert(MAX_BLUR_TAPS >= 2 * MAX_BLUR_RADIUS + 1, "taps of one Convolve()");
+    struct BlurRun // pixels XStart thru XEnd - 1 of a row are in radial zone
+    {
+        int32_t XStart;
+        int32_t XEnd;
+        uint8_t zone;
+    };
+    int                   m_blurRadius;
+    bool                  m_blurSeparable;
+    std::vector<uint32_t> m_blurKernelX;    // separable taps of each zone
+    std::vector<uint32_t> m_blurKernelY;
+    std::vector<uint32_t> m_blurKernel2D;   // non-separable taps
+    std::vector<BlurRun>  m_blurRuns;       // runs of all rows
+    std::vector<int32_t>  m_blurRowRuns;    // index of first run of each row
+    std::vector<uint32_t> m_blurRing;       // ring buffer of padded lens distorted rows
+    std::vector<uint32_t> m_blurTmp;        // padded vertical pass of separable blur
+    std::vector<uint32_t> m_blurOut;        // blurred row
+
+    // Poisson noise random streams
+    static const int PIXEL_RANDS_SHIFT = 16; // log2 of random values per pixel
+    uint64_t m_seedNoise;
+    uint64_t m_frame;       // frame number of next AddDistortion()
+    Rng      m_frameRng;    // random stream of current frame
+    static const int NOISE_BLOCK_SHIFT = 5; // log2 of pixels per noise LUT column offset
+    static const int NOISE_BLOCK       = 1 << NOISE_BLOCK_SHIFT;
+    std::vector<uint8_t> m_noiseOffsets; // noise LUT column offset of each block of current row
+    std::vector<uint8_t> m_noiseStrides; // and odd column stride
+
     // LUTs that take pixel value as input
-    uint8_t m_noiseIdx;
-    std::array<uint16_t, 256*256> m_noiseLUT;    // 2D, 8-bit input, 16-bit output
-    std::array<uint8_t,     4096> m_pwlLUT;      // 12-bit input,  8-bit output
+    static const int NOISE_BUCKET_SHIFT = 7;  // values per quantile LUT row
+    static const int NUM_NOISE_BUCKETS  = NOISE_LUT_MAX >> NOISE_BUCKET_SHIFT;
+    static const int NOISE_SQRT_FBITS   = 8;  // fractional bits of m_noiseSqrt
+    static const int NOISE_Z_FBITS      = 10; // fractional bits of m_noiseQuantiles
+    static const int NOISE_FBITS        = NOISE_SQRT_FBITS + NOISE_Z_FBITS;
+    static const int NOISE_ROUND        = 1 << (NOISE_FBITS - 1);
+    static const int NOISE_BIAS         = 1 << 30; // > |sqrt * z| (< 2^14 * 2^15), multiple of 1 << NOISE_FBITS
+    uint32_t m_noiseLUTMax;
+    std::array<uint16_t, 256*256 + GATHER_PAD> m_noiseLUT; // 2D, 8-bit input, 16-bit output
+    std::array<int16_t,  NUM_NOISE_BUCKETS*256 + GATHER_PAD> m_noiseQuantiles; // 2D, standardized
+    std::array<uint16_t, NOISE_LUT_MAX + GATHER_PAD> m_noiseSqrt; // 12-bit input, sqrt
+    std::array<uint8_t,     4096 + GATHER_PAD> m_pwlLUT;   // 12-bit input,  8-bit output
     std::array<uint32_t,     256> m_byte2rgbLUT; //  8-bit input, 32-bit output
 };
 
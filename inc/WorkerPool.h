@@ -0,0 +1,111 @@
+#pragma once
+
+#ifndef __WorkerPool_h__
+#define __WorkerPool_h__
+
+#include <stdint.h> // int32_t, etc
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+// Persistent pool of worker threads that all run the same job, e.g. each
+// worker rendering its own horizontal band of a canvas. Threads are created
+// once and then sleep between jobs so there is no thread creation per frame.
+// The calling thread acts as worker 0, so a pool of N workers owns N - 1
+// threads.
+class WorkerPool
+{
+public:
+    ////////////////////////////////////////////////////////////////////////////
+    WorkerPool(int32_t numWorkers = 0) : // 0 = one per hardware thread
+        m_pJob(nullptr),
+        m_generation(0),
+        m_numBusy(0),
+        m_stop(false)
+    {
+        if (numWorkers <= 0) { numWorkers = (int32_t)std::thread::hardware_concurrency(); }
+        if (numWorkers <= 0) { numWorkers = 1; } // hardware_concurrency() unknown
+
+        m_numWorkers = numWorkers;
+        for (int32_t idx = 1; idx < numWorkers; ++idx)
+        {
+            m_threads.emplace_back(&WorkerPool::WorkerLoop, this, idx);
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    ~WorkerPool(void)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_startCv.notify_all();
+        for (size_t ii = 0; ii < m_threads.size(); ++ii) { m_threads[ii].join(); }
+    }
+
+    inline int32_t NumWorkers(void) const { return m_numWorkers; }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Run job(workerIdx) on every worker, workerIdx = 0 .. NumWorkers() - 1,
+    // and return once all of them have finished.
+    void Run(const std::function<void(int32_t)>& job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pJob    = &job;
+            m_numBusy = m_numWorkers - 1;
+            ++m_generation; // wakes workers
+        }
+        m_startCv.notify_all();
+
+        job(0); // calling thread is worker 0
+
+        // wait for the other workers
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_doneCv.wait(lock, [this] { return m_numBusy == 0; });
+        m_pJob = nullptr;
+    }
+
+private:
+    ////////////////////////////////////////////////////////////////////////////
+    void WorkerLoop(int32_t idx)
+    {
+        uint64_t lastGeneration = 0;
+        for (;;)
+        {
+            const std::function<void(int32_t)>* pJob;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_startCv.wait(lock, [&] { return m_stop || (m_generation != lastGeneration); });
+                if (m_stop) { return; }
+                lastGeneration = m_generation;
+                pJob = m_pJob;
+            }
+
+            (*pJob)(idx);
+
+            bool lastDone;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                lastDone = (--m_numBusy == 0);
+            }
+            if (lastDone) { m_doneCv.notify_one(); }
+        }
+    }
+
+    int32_t                  m_numWorkers;
+    std::vector<std::thread> m_threads;
+
+    std::mutex               m_mutex;
+    std::condition_variable  m_startCv;    // signals a new job (or stop)
+    std::condition_variable  m_doneCv;     // signals all workers finished
+    const std::function<void(int32_t)>* m_pJob; // job of current generation
+    uint64_t                 m_generation; // incremented for each job
+    int32_t                  m_numBusy;    // workers still running the job
+    bool                     m_stop;       // set to exit worker threads
+};
+
+#endif
@@ -4,7 +4,89 @@
 #define __random_h__
 
 #include <stdint.h> // int32_t, etc
+#include <limits>   // std::numeric_limits
 
+////////////////////////////////////////////////////////////////////////////////
+// Counter-based random number generator: value n of a stream is a hash of
+// (seed, stream, n), i.e. SplitMix64 with a per-stream increment. Unlike
+// rand() there is no global state, so streams (e.g. one per thread, frame or
+// pixel) can be generated in parallel, and seeking to a counter regenerates
+// any value deterministically.
+class Rng
+{
+public:
+    Rng(uint64_t seed = 0, uint64_t stream = 0) { Seed(seed, stream); }
+
+    // Select stream of seed and rewind to its first value
+    void Seed(uint64_t seed, uint64_t stream = 0)
+    {
+        m_base    = Mix64(seed);
+        m_gamma   = MixGamma(m_base + Mix64(stream + GOLDEN_GAMMA));
+        m_counter = 0;
+    }
+
+    inline void     Seek(uint64_t counter) { m_counter = counter; }
+    inline uint64_t Tell(void) const       { return m_counter; }
+
+    // Value at a counter, does not change the position of the stream
+    inline uint64_t At(uint64_t counter) const { return Mix64(m_base + (counter + 1) * m_gamma); }
+
+    inline uint64_t Next64(void) { return At(m_counter++); }
+    inline uint32_t Next32(void) { return (uint32_t)(Next64() >> 32); }
+
+    // Uniform float in [0, 1) with 24 bits of precision
+    inline float Uniform(void) { return (float)(Next64() >> 40) * (1.0f / (1 << 24)); }
+
+    // Bulk generation. Each value only depends on its counter so there is no
+    // dependency between loop iterations (they pipeline or vectorize).
+    void Fill(uint32_t* pOut, uint32_t count)
+    {
+        const uint64_t counter = m_counter;
+        for (uint32_t ii = 0; ii < count; ++ii) { pOut[ii] = (uint32_t)(At(counter + ii) >> 32); }
+        m_counter += count;
+    }
+
+    void FillUniform(float* pOut, uint32_t count)
+    {
+        const uint64_t counter = m_counter;
+        for (uint32_t ii = 0; ii < count; ++ii)
+        {
+            pOut[ii] = (float)(At(counter + ii) >> 40) * (1.0f / (1 << 24));
+        }
+        m_counter += count;
+    }
+
+    // SplitMix64 finalizer, a bijection with good avalanche
+    static inline uint64_t Mix64(uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+private:
+    // Odd increment with enough bit transitions to be well mixed (as per
+    // Java's SplittableRandom)
+    static inline uint64_t MixGamma(uint64_t z)
+    {
+        z = Mix64(z) | 1u;
+        uint64_t transitions = z ^ (z >> 1);
+        int numTransitions = 0;
+        while (transitions) { transitions &= transitions - 1; ++numTransitions; }
+        return (numTransitions < 24) ? (z ^ 0xAAAAAAAAAAAAAAAAull) : z;
+    }
+
+    static const uint64_t GOLDEN_GAMMA = 0x9E3779B97F4A7C15ull;
+
+    uint64_t m_base;    // hash of seed
+    uint64_t m_gamma;   // per-stream increment
+    uint64_t m_counter; // position in stream
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Default generator of the calling thread, used by the functions below when
+// no generator is given, so they are thread-safe
+Rng& ThreadRng(void);
 
 ////////////////////////////////////////////////////////////////////////////////
 // 1-pass calculation of mean and variance of an array
@@ -32,29 +114,46 @@ template <class T> void MeanVariance(
 
 ////////////////////////////////////////////////////////////////////////////////
 // Gaussian random number generator with zero mean and unit variance.
-float randn(void);
+// Uses the Ziggurat method, so tails are not clipped.
+float randn(Rng& rng = ThreadRng());
+
+////////////////////////////////////////////////////////////////////////////////
+// Fill an array with Gaussian random numbers with zero mean and unit
+// variance. Faster per sample than randn() for large counts.
+void RandnFill(
+    float*    pOut,   // output values
+    uint32_t  count,  // number of values to generate
+    Rng&      rng = ThreadRng());
 
 ////////////////////////////////////////////////////////////////////////////////
 // Return integer drawn from poisson distribution with parameter "p".
-// Note: for p > 500, exp(-p) might overflow
-// so use gaussian approximation: round(sqrt(p) * randn() + p)
-uint32_t randp(float p);
+// Exact for all p, O(1) for p >= 10 (transformed rejection, PTRS).
+uint32_t randp(float p, Rng& rng = ThreadRng());
 
 ////////////////////////////////////////////////////////////////////////////////
-// Generate random numbers from a Poisson distribution with parameter "p".
-// When p >= 20, uses Gaussian approximation: round(sqrt(p) * randn() + p)
-void PoissonDist(
-    float     p,     // parameter of Poisson distribution
-    uint32_t  count, // number of values to generate
-    uint32_t* pOut); // output values
+// Batched versions of randp(): fill an array with Poisson samples with the
+// same parameter "p" (set up once for the batch) or parameter pP[i] for
+// sample i (e.g. photon counts of pixels). pOut may equal pP.
+void PoissonFill(
+    float           p,     // parameter of Poisson distribution
+    uint32_t        count, // number of values to generate
+    uint32_t*       pOut,  // output values
+    Rng&            rng = ThreadRng());
+
+void PoissonFill(
+    const uint32_t* pP,    // parameter of each sample
+    uint32_t        count, // number of values to generate
+    uint32_t*       pOut,  // output values
+    Rng&            rng = ThreadRng());
 
 ////////////////////////////////////////////////////////////////////////////////
-// Generate random integers drawn from Poisson distribution with parameter "p".
-// Uses Gaussian approximation for p >= 20.
+// Generate random integers drawn from Poisson distribution with parameter "p",
+// saturated to the range of T.
 template <class T = uint32_t> void PoissonDist(
     float     lam,   // mean and variance of Poisson distribution
     uint32_t  count, // number of values to generate
-    T*        pOut)  // output values drawn from Poisson distribution
+    T*        pOut,  // output values drawn from Poisson distribution
+    Rng&      rng = ThreadRng())
 {
     if (lam == 0.0f)
     {
@@ -63,24 +162,16 @@ template <class T = uint32_t> void PoissonDist(
     }
 
     const T maxVal = std::numeric_limits<T>::max();
-    if (lam < 20.0f)
+    uint32_t values[256];
+    while (count)
     {
-        while (count--)
+        const uint32_t num = (count < 256u) ? count : 256u;
+        PoissonFill(lam, num, values, rng);
+        for (uint32_t ii = 0; ii < num; ++ii)
         {
-            uint32_t value = randp(lam);
-            if (value > maxVal) { value = maxVal; }
-            *pOut++ = (T)value;
+            *pOut++ = (values[ii] > maxVal) ? maxVal : (T)values[ii];
         }
-        return;
-    }
-    const float mean   = lam;
-    const float stddev = sqrtf(lam);
-    while (count--)
-    {
-        float gaussian = stddev * randn() + mean;
-        if (gaussian < 0.0f) { gaussian = 0.0f; } // Poisson is non-negative
-        uint32_t value = (uint32_t)(gaussian + 0.5f); // round to integer
-        *pOut++ = (value > maxVal) ? maxVal : (T)value;
+        count -= num;
     }
 }
 
@@ -1,6 +1,8 @@
 #include <assert.h>
+#include <string.h> // memcpy()
 
 #include "RenderFXP.h"
+#include "DepthBuffer.h"
 
 #define SWAP(x, y) { \
     int tmp = x; \
@@ -8,93 +10,36 @@
     y = tmp; }
 
 #define ABS(x) (((x) < 0) ? (-(x)) : (x))
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
 
 ////////////////////////////////////////////////////////////////////////////////
 // typedefs for usage internal to this file
 
-// Describes beginning and ending X coordinates of a single horizontal line
-typedef struct { int32_t XStart; int32_t XEnd; } HLine;
-
 /* Describes a Length-long series of horizontal lines, all assumed to
    be on contiguous scan lines starting at YStart and proceeding
    downward (used to describe a scan-converted polygon to the
-   low-level hardware-dependent drawing code). */
+   low-level hardware-dependent drawing code).
+   HLinePtr points to the scratch space of a RasterContext. */
 typedef struct {
     int32_t Length;
     int32_t YStart;
-    HLine   HLinePtr[MAX_SCREEN_HEIGHT];
+    HLine*  HLinePtr;
 } HLineList;
 
-////////////////////////////////////////////////////////////////////////////////
-Fixedpoint FixedMul(Fixedpoint M1, Fixedpoint M2)
-{
-    // TODO: rounding
-    // Note: downshift of a signed value is considered undefined so
-    // we use an actual divide here. The compiler should replace with a shift.
-    return (Fixedpoint)(((int64_t)M1 * (int64_t)M2) / (1 << FIXED_FBITS));
-}
-
-////////////////////////////////////////////////////////////////////////////////
-Fixedpoint FixedDiv(Fixedpoint M1, Fixedpoint M2)
-{
-    // TODO: rounding
-    if (M2 == 0) { M2 = 1; } // avoid div-by-0
-    return (Fixedpoint)(((int64_t)M1 << FIXED_FBITS) / (int64_t)M2);
-}
-
-////////////////////////////////////////////////////////////////////////////////
-/* Matrix multiplies Xform by SourceVec, and stores the result in DestVec.
-   Multiplies a 4x4 matrix times a 4x1 matrix; the result is a 4x1 matrix. Cheats
-   by assuming the W coord is 1 and bottom row of matrix is 0 0 0 1, and doesn't
-   bother to set the W coordinate of the destination. */
-/* Example:
-   [dst1]   [a b c d]   [src1]
-   [dst2] = [e f g h] * [src2]
-   [dst3]   [i j k l]   [src3]
-   [ 1  ]   [0 0 0 1]   [  1 ] */
-void XformVec(
-    Xform       WorkingXform,
-    Fixedpoint* SourceVec,
-    Fixedpoint* DestVec)
-{
-   for (int i=0; i < 3; i++)
-   {
-      DestVec[i] = FixedMul(WorkingXform[i][0],      SourceVec[0]) +
-                   FixedMul(WorkingXform[i][1],      SourceVec[1]) +
-                   FixedMul(WorkingXform[i][2],      SourceVec[2]) +
-                            WorkingXform[i][3]; // * SourceVec[3] = W = 1.0
-   }
-}
+/* Depth of a polygon in screen space. Depth is proportional to 1/distance so
+   it's linear in screen X and Y:
+       depth(X, Y) = Z0 + DZDX * X + DZDY * Y
+   with DEPTH_FBITS fractional bits. */
+typedef struct {
+    int64_t Z0;
+    int32_t DZDX;
+    int32_t DZDY;
+} DepthPlane;
 
-////////////////////////////////////////////////////////////////////////////////
-/* Matrix multiplies SourceXform1 by SourceXform2 and stores result in
-   DestXform.
-   Cheats by assuming bottom row of each matrix is 0 0 0 1, and doesn't bother
-   to set the bottom row of the destination. */
-/* Example:
-   DestXform     = SourceXform1  * SourceXform2
-
-   [da db dc dd]   [a1 b1 c1 d1]   [a2 b2 c2 d2]
-   [de df df dh] = [e1 f1 g1 h1] * [e2 f2 g2 h2]
-   [di dj dk dl]   [i1 j1 k1 l1]   [i2 j2 k2 l2]
-   [ 0  0  0  1]   [ 0  0  0  1]   [ 0  0  0  1] */
-void ConcatXforms(
-   Xform SourceXform1,
-   Xform SourceXform2,
-   Xform DestXform)
-{
-   for (int i=0; i < 3; i++)    // loop thru rows of DestXform
-   {
-      for (int j=0; j < 4; j++) // loop thru columns of DestXForm
-      {
-         DestXform[i][j] =
-               FixedMul(SourceXform1[i][0],      SourceXform2[0][j]) +
-               FixedMul(SourceXform1[i][1],      SourceXform2[1][j]) +
-               FixedMul(SourceXform1[i][2],      SourceXform2[2][j]) +
-                        SourceXform1[i][3]; // * SourceXform2[3][3] = 1
-      }
-   }
-}
+// Limit of depth change per pixel. Only reached by polygons seen nearly edge
+// on and keeps a tile's worth of depth steps within int32_t.
+#define DEPTH_MAX_GRADIENT (1 << (30 - DEPTH_TILE_SHIFT))
 
 ////////////////////////////////////////////////////////////////////////////////
 /* Transforms all vertices in the specified polygon-based object into view
@@ -128,12 +73,16 @@ void XformAndProjectPObject(
    Point3* XformedPts = ObjectToXform->XformedVertexList;
    Point3* ProjPts    = ObjectToXform->ProjectedVertexList;
    Point*  ScreenPts  = ObjectToXform->ScreenVertexList;
+   int64_t SumX = 0, SumY = 0, SumZ = 0; // for centroid
    for (int i=0; i < NumPoints; i++, Pts++, XformedPts++, ProjPts++, ScreenPts++)
    {
       // xform from world to view coordinates
       XformVec(ObjectToXform->XformToView,
               (Fixedpoint*)Pts,
               (Fixedpoint*)XformedPts);
+      SumX += XformedPts->X;
+      SumY += XformedPts->Y;
+      SumZ += XformedPts->Z;
 
       // Perspective-project from view to projection plane:
       //     projX = viewX / viewZ * (nearClipZ * width/2)
@@ -148,6 +97,14 @@ void XformAndProjectPObject(
       ScreenPts->X =  FIXED_TO_INT(ProjPts->X) + widthDiv2;
       ScreenPts->Y = -FIXED_TO_INT(ProjPts->Y) + heightDiv2;
    }
+
+   // Centroid in view space, used to sort objects by depth
+   if (NumPoints > 0)
+   {
+      ObjectToXform->CenterInView.X = (Fixedpoint)(SumX / NumPoints);
+      ObjectToXform->CenterInView.Y = (Fixedpoint)(SumY / NumPoints);
+      ObjectToXform->CenterInView.Z = (Fixedpoint)(SumZ / NumPoints);
+   }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -413,10 +370,12 @@ void RotateAndMovePObject(PObject * ObjectToMove)
    filled in. */
 
 void DrawPObject(
-    PObject* ObjectToXform,
-    Canvas*  pCanvas)
+    PObject*       ObjectToXform,
+    RasterContext* pContext)
 {
-   Point* ScreenPoints = ObjectToXform->ScreenVertexList;
+   Point*  ScreenPoints = ObjectToXform->ScreenVertexList;
+   Point3* ProjPoints   = ObjectToXform->ProjectedVertexList;
+   const DepthBuffer* pDepth = pContext->pDepth;
 
    // Draw each visible face (polygon) of the object in turn
    const int NumFaces = ObjectToXform->NumFaces;
@@ -430,7 +389,7 @@ void DrawPObject(
       Point Vertices[MAX_POLY_LENGTH];
       for (int j = 0; j < NumVertices; j++)
       {
-         Vertices[j] = ScreenPoints[*VertNumsPtr++];
+         Vertices[j] = ScreenPoints[VertNumsPtr[j]];
       }
 
       // Draw only if face normal points toward viewer (i.e. has a positive Z)
@@ -439,19 +398,336 @@ void DrawPObject(
       long v2 = Vertices[            1].Y - Vertices[0].Y;
       long w2 = Vertices[NumVertices-1].Y - Vertices[0].Y;
       if ((v1*w2 - v2*w1) > 0) { // if facing the screen, draw
-         FillConvexPolygon(Vertices, NumVertices, FacePtr->Color, 0, 0, pCanvas);
+         if (pDepth == nullptr)
+         {
+            FillConvexPolygon(Vertices, NumVertices, FacePtr->Color, 0, 0, pContext);
+         }
+         else
+         {
+            int32_t Depths[MAX_POLY_LENGTH];
+            for (int j = 0; j < NumVertices; j++)
+            {
+               Depths[j] = pDepth->ViewZToDepth(ProjPoints[VertNumsPtr[j]].Z);
+            }
+            FillConvexPolygon(Vertices, NumVertices, FacePtr->Color, 0, 0, pContext, Depths);
+         }
       }
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Integer square root: returns floor(sqrt(x))
+static uint32_t ISqrt64(uint64_t x)
+{
+    uint64_t root = 0;
+    uint64_t bit  = 1ull << 62; // highest power of 4 <= 2^64
+    while (bit > x) { bit >>= 2; }
+    while (bit != 0)
+    {
+        if (x >= root + bit)
+        {
+            x    -= root + bit;
+            root  = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Radius of sphere about the object origin that contains all its vertices
+static Fixedpoint ComputeBoundRadius(const PObject* Object)
+{
+    uint64_t MaxRadius2 = 0; // Q32.32
+    const Point3* Pts = Object->VertexList;
+    for (int i = 0; i < Object->NumVerts; i++, Pts++)
+    {
+        uint64_t Radius2 = (uint64_t)((int64_t)Pts->X * Pts->X) +
+                           (uint64_t)((int64_t)Pts->Y * Pts->Y) +
+                           (uint64_t)((int64_t)Pts->Z * Pts->Z);
+        if (Radius2 > MaxRadius2) { MaxRadius2 = Radius2; }
+    }
+    return (Fixedpoint)ISqrt64(MaxRadius2) + 1; // + 1 to round up
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Extrapolate an object's XformToWorld to TimeUsec after its current pose,
+// where one MoveFunc call spans MoveUsec. Move and Rotate increments are
+// averaged over the delay counts.
+static void PoseAtTime(
+    const PObject* Object,
+    int32_t        TimeUsec,
+    int32_t        MoveUsec,
+    Xform          Pose)     // out: extrapolated object->world xform
+{
+    memcpy(Pose, Object->XformToWorld, sizeof(Xform));
+    if (MoveUsec <= 0) { return; } // no motion model
+
+    // number of MoveFunc calls elapsed
+    const Fixedpoint Steps =
+        (Fixedpoint)(((int64_t)TimeUsec << FIXED_FBITS) / MoveUsec);
+
+    // rotate once every (RDelayCountBase + 1) calls, in RotateAndMovePObject() order
+    const Fixedpoint RSteps = Steps / (Object->RDelayCountBase + 1);
+    if (Object->Rotate.RotateX != 0)
+        AppendRotationX(Pose, FixedMul(Object->Rotate.RotateX, RSteps));
+    if (Object->Rotate.RotateY != 0)
+        AppendRotationY(Pose, FixedMul(Object->Rotate.RotateY, RSteps));
+    if (Object->Rotate.RotateZ != 0)
+        AppendRotationZ(Pose, FixedMul(Object->Rotate.RotateZ, RSteps));
+
+    // move once every (MDelayCountBase + 1) calls
+    const Fixedpoint MSteps = Steps / (Object->MDelayCountBase + 1);
+    Pose[0][3] += FixedMul(Object->Move.MoveX, MSteps);
+    Pose[1][3] += FixedMul(Object->Move.MoveY, MSteps);
+    Pose[2][3] += FixedMul(Object->Move.MoveZ, MSteps);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns 1 if the object's bounding sphere at Pose projects entirely above
+// or below screen rows YMin thru YMax (i.e. outside the line group frustum)
+static int OutsideRows(
+    const PObject* Object,
+    Xform          Pose,
+    Fixedpoint     nearClipZ,
+    int            widthDiv2,
+    int            heightDiv2,
+    int            YMin,
+    int            YMax)
+{
+    // Object origin in view space
+    // Note: world->view xform is identity (see XformAndProjectPObject())
+    const int64_t CenterY = Pose[1][3];
+    const int64_t Dist    = -(int64_t)Pose[2][3]; // distance in front of viewpoint
+    const int64_t Radius  = Object->BoundRadius;
+    if (Dist - Radius <= 0) { return 0; } // sphere reaches viewpoint, can't cull
+
+    // Same projection as XformAndProjectPObject():
+    //     screenY = heightDiv2 - viewY * Focal / Dist
+    const int64_t Focal = -(int64_t)FixedMul(nearClipZ, INT_TO_FIXED(widthDiv2));
+
+    // Highest and lowest view Y of sphere, each divided by the distance that
+    // pushes it furthest from the screen center
+    const int64_t Top     = CenterY + Radius;
+    const int64_t Bot     = CenterY - Radius;
+    const int64_t TopDist = (Top >= 0) ? (Dist - Radius) : (Dist + Radius);
+    const int64_t BotDist = (Bot >= 0) ? (Dist + Radius) : (Dist - Radius);
+
+    // 2 pixel margin for rounding
+    const int64_t ScreenTop = heightDiv2 - (Top * Focal / TopDist) / FIXED_ONE - 2;
+    const int64_t ScreenBot = heightDiv2 - (Bot * Focal / BotDist) / FIXED_ONE + 2;
+
+    return ((ScreenBot < YMin) || (ScreenTop > YMax)) ? 1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Render line groups of a rolling shutter sensor (see RenderFXP.h)
+void RenderRollingShutter(
+    PObject**             ObjectList,
+    int32_t               NumObjects,
+    RasterContext*        pContext,
+    Fixedpoint            nearClipZ,
+    const RollingShutter* pShutter)
+{
+    Canvas* pCanvas = pContext->pCanvas;
+    const int width      = pCanvas->Width();
+    const int height     = pCanvas->Height();
+    const int widthDiv2  = width  / 2;
+    const int heightDiv2 = height / 2;
+
+    const int32_t LinesPerGroup = (pShutter->LinesPerGroup   > 0) ? pShutter->LinesPerGroup   : 1;
+    const int32_t NumSubExp     = (pShutter->NumSubExposures > 0) ? pShutter->NumSubExposures : 1;
+
+    for (int i = 0; i < NumObjects; i++)
+    {
+        if (ObjectList[i]->BoundRadius == 0)
+        {
+            ObjectList[i]->BoundRadius = ComputeBoundRadius(ObjectList[i]);
+        }
+    }
+
+    // caller's raster settings, restored when done
+    const RasterOp SavedRop      = pContext->Rop;
+    const int32_t  SavedYClipMin = pContext->YClipMin;
+    const int32_t  SavedYClipMax = pContext->YClipMax;
+    pContext->Rop = RASTER_ADD; // sum sub-exposures
+
+    int32_t GroupStartUsec = 0; // time line group starts exposing
+    for (int YMin = 0; YMin < height; YMin += LinesPerGroup)
+    {
+        const int YMax = (YMin + LinesPerGroup - 1 < height) ?
+                         (YMin + LinesPerGroup - 1) : (height - 1);
+        pContext->YClipMin = YMin; // only draw rows of this line group
+        pContext->YClipMax = YMax;
+
+        // Init lines to zero photons
+        for (int Y = YMin; Y <= YMax; ++Y) { pCanvas->FillSpan(0, width - 1, Y, 0u); }
+
+        for (int32_t Sub = 0; Sub < NumSubExp; ++Sub)
+        {
+            // each sub-exposure is depth tested on its own
+            if (pContext->pDepth) { pContext->pDepth->ClearRows(YMin, YMax); }
+
+            // time at middle of sub-exposure
+            const int32_t TimeUsec = GroupStartUsec + (int32_t)
+                (((int64_t)(2 * Sub + 1) * pShutter->ExposureUsec) / (2 * NumSubExp));
+
+            for (int i = 0; i < NumObjects; i++)
+            {
+                PObject* Object = ObjectList[i];
+
+                Xform Pose;
+                PoseAtTime(Object, TimeUsec, pShutter->MoveUsec, Pose);
+                if (OutsideRows(Object, Pose, nearClipZ, widthDiv2, heightDiv2, YMin, YMax))
+                {
+                    continue; // object misses this line group
+                }
+
+                // A static object (or one not moved since its last projection)
+                // is projected once and reused by every line group
+                const int Moving = (memcmp(Pose, Object->XformToWorld, sizeof(Xform)) != 0);
+                if (Moving || Object->RecalcXform)
+                {
+                    Xform SavedXform;
+                    memcpy(SavedXform, Object->XformToWorld, sizeof(Xform));
+                    memcpy(Object->XformToWorld, Pose, sizeof(Xform));
+                    Object->RecalcFunc(Object, pCanvas, nearClipZ);
+                    memcpy(Object->XformToWorld, SavedXform, sizeof(Xform));
+
+                    // projected vertices only match XformToWorld if not moving
+                    Object->RecalcXform = Moving;
+                }
+
+                Object->DrawFunc(Object, pContext);
+            }
+        }
+        GroupStartUsec += pShutter->ReadoutUsec;
+    }
+
+    pContext->Rop      = SavedRop;
+    pContext->YClipMin = SavedYClipMin;
+    pContext->YClipMax = SavedYClipMax;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw pixels XStart thru XEnd of row Y with the raster op
+static inline void DrawSpan(
+    Canvas*  pCanvas,
+    RasterOp Rop,
+    int      XStart, int XEnd, int Y,
+    uint32_t Color)
+{
+    if (Rop == RASTER_ADD) { pCanvas->AddSpan (XStart, XEnd, Y, Color); }
+    else                   { pCanvas->FillSpan(XStart, XEnd, Y, Color); }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Clamp interpolated depth to the range of the depth buffer
+static inline int32_t ClampDepth(int64_t Z)
+{
+    if (Z < 0)                                  { return 0; }
+    if (Z > ((int64_t)DEPTH_MAX << DEPTH_FBITS)) { return DEPTH_MAX << DEPTH_FBITS; }
+    return (int32_t)Z;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/* Depth tests pixels XStart thru XEnd of row Y, writes the depth of visible
+   pixels and draws each run of visible pixels with a single span.
+   The span is processed one depth tile at a time: a tile segment that is
+   entirely behind the tile's nearest bound is skipped and one entirely in
+   front of its farthest bound is drawn without per-pixel tests, so only
+   tiles where depths interleave are tested pixel by pixel. */
+static void DrawDepthSpan(
+    Canvas*      pCanvas,
+    RasterOp     Rop,
+    int          XStart, int XEnd, int Y,
+    uint32_t     Color,
+    int64_t      ZStart, // depth at XStart
+    int32_t      DZDX,   // depth change per pixel
+    DepthBuffer* pDepth)
+{
+    uint16_t* pRow     = pDepth->Row(Y);
+    uint16_t* pTileMin = pDepth->TileMin(Y);
+    uint16_t* pTileMax = pDepth->TileMax(Y);
+    const int width    = pDepth->Width();
+
+    int RunStart = -1; // first pixel of visible run not yet drawn
+    for (int X0 = XStart; X0 <= XEnd; )
+    {
+        // segment X0 thru X1 of span lies within tile TileX0 thru TileX1
+        const int Tile   = X0 >> DEPTH_TILE_SHIFT;
+        const int TileX0 = Tile << DEPTH_TILE_SHIFT;
+        const int TileX1 = MIN(TileX0 + DEPTH_TILE_WIDTH, width) - 1;
+        const int X1     = MIN(TileX1, XEnd);
+        const int Full   = (X0 == TileX0) && (X1 == TileX1); // covers tile
+
+        // Depth is linear so the segment's range is set by its end points
+        int32_t Z = ClampDepth(ZStart + (int64_t)DZDX * (X0 - XStart));
+        const int32_t ZLast  = ClampDepth((int64_t)Z + (int64_t)DZDX * (X1 - X0));
+        const uint16_t SegMin = (uint16_t)(MIN(Z, ZLast) >> DEPTH_FBITS);
+        const uint16_t SegMax = (uint16_t)(MAX(Z, ZLast) >> DEPTH_FBITS);
+
+        if (SegMax < pTileMin[Tile])
+        {
+            // hidden by everything already in the tile
+            if (RunStart >= 0) { DrawSpan(pCanvas, Rop, RunStart, X0 - 1, Y, Color); }
+            RunStart = -1;
+        }
+        else if (SegMin >= pTileMax[Tile])
+        {
+            // in front of everything already in the tile
+            for (int X = X0; X <= X1; ++X, Z += DZDX)
+            {
+                pRow[X] = (uint16_t)(ClampDepth(Z) >> DEPTH_FBITS);
+            }
+            if (RunStart < 0) { RunStart = X0; }
+            if (Full) { pTileMin[Tile] = SegMin; } // tile now holds only segment
+            pTileMax[Tile] = SegMax;
+        }
+        else
+        {
+            // test each pixel
+            int NumVisible = 0;
+            for (int X = X0; X <= X1; ++X, Z += DZDX)
+            {
+                const uint16_t D = (uint16_t)(ClampDepth(Z) >> DEPTH_FBITS);
+                if (D >= pRow[X])
+                {
+                    pRow[X] = D;
+                    NumVisible++;
+                    if (RunStart < 0) { RunStart = X; }
+                }
+                else if (RunStart >= 0)
+                {
+                    DrawSpan(pCanvas, Rop, RunStart, X - 1, Y, Color);
+                    RunStart = -1;
+                }
+            }
+            if (NumVisible > 0)
+            {
+                if (Full && (NumVisible == X1 - X0 + 1)) { pTileMin[Tile] = SegMin; }
+                if (SegMax > pTileMax[Tile]) { pTileMax[Tile] = SegMax; }
+            }
+        }
+        X0 = X1 + 1;
+    }
+    if (RunStart >= 0) { DrawSpan(pCanvas, Rop, RunStart, XEnd, Y, Color); }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void DrawHorizontalLineList(
-    const HLineList* HLineListPtr, // array of horizontal lines
-    int              Color,        // TODO: remove this later
-    Canvas*          pCanvas)      // ptr to function
+    const HLineList*     HLineListPtr, // array of horizontal lines
+    int                  Color,        // TODO: remove this later
+    const DepthPlane*    pPlane,       // polygon depth, nullptr = no depth test
+    const RasterContext* pContext)     // canvas, raster op and depth buffer
 {
-    const int width  = pCanvas->Width();
-    const int height = pCanvas->Height();
+    Canvas*        pCanvas = pContext->pCanvas;
+    const RasterOp Rop     = pContext->Rop;
+    const int      width   = pCanvas->Width();
 
     // Draw each horizontal line in turn, starting with the top
     const int    YStart   = HLineListPtr->YStart;
@@ -459,9 +735,8 @@ void DrawHorizontalLineList(
     const HLine* HLinePtr = HLineListPtr->HLinePtr; // first (top) horizontal line
     for (int Y = YStart; Y <= YEnd; ++Y, HLinePtr++)
     {
-        // bounds check Y
-        if (Y <       0) { continue; }
-        if (Y >= height) { continue; }
+        // Note: Y was already clipped to the canvas by FillConvexPolygon()
+        assert((0 <= Y) && (Y < pCanvas->Height()));
 
         // bounds check X
         int XStart = HLinePtr->XStart;
@@ -470,12 +745,19 @@ void DrawHorizontalLineList(
         if (XEnd   <      0) { continue; }
         if (XStart <      0) { XStart = 0; }
         if (XEnd   >= width) { XEnd = width - 1; }
+        if (XStart >   XEnd) { continue; } // empty span (edges touch)
 
-        // Draw each pixel in the current horizontal line in turn,
-        // starting with the leftmost one
-        for (int X = XStart; X <= XEnd; ++X)
+        if (pPlane == nullptr)
         {
-            pCanvas->SetPixel(X, Y, Color);
+            // Draw the whole horizontal line with one call
+            DrawSpan(pCanvas, Rop, XStart, XEnd, Y, Color);
+        }
+        else
+        {
+            const int64_t ZStart = pPlane->Z0 + (int64_t)pPlane->DZDX * XStart
+                                              + (int64_t)pPlane->DZDY * Y;
+            DrawDepthSpan(pCanvas, Rop, XStart, XEnd, Y, Color,
+                          ZStart, pPlane->DZDX, pContext->pDepth);
         }
     }
 }
@@ -486,7 +768,9 @@ void DrawHorizontalLineList(
    the start of the next, and causes the bottom scan line of the
    polygon not to be drawn. If SkipFirst != 0, the point at (X1,Y1)
    isn't drawn. For each scan line, the pixel closest to the scanned
-   line without being to the left of the scanned line is chosen. */
+   line without being to the left of the scanned line is chosen.
+   Only scan lines YListTop thru YListBot are stored (clipping), with
+   scan line Y stored at LineList[Y - YListTop]. */
 
 /* ScanEdge() is an integer version of following simpler code:
 
@@ -519,16 +803,29 @@ static void ScanEdge(
     int     X2, int Y2,
     int     SetXStart,
     int     SkipFirst,
-    HLine** EdgePointPtr)
+    HLine*  LineList,   // entry 0 holds scan line YListTop
+    int     YListTop,   // first scan line stored in LineList
+    int     YListBot)   // last scan line stored in LineList
 {
    int ErrorTerm;
    int ErrorTermAdvance, XMajorAdvanceAmt;
 
-   HLine* WorkingEdgePointPtr = *EdgePointPtr; // avoid 2x dereference
-
    int Height = Y2 - Y1;        // Y length of the edge
    if (Height <= 0) { return; } // guard against 0-length and horizontal edges
 
+   // Clip the scan lines of this edge (Y1 + SkipFirst thru Y2 - 1) to the
+   // lines held by LineList. Lines above the list are stepped over in one
+   // go below rather than scanned, so clipped edges cost almost nothing.
+   int YFirst = Y1 + SkipFirst;
+   int YLast  = Y2 - 1;
+   if (YFirst < YListTop) { YFirst = YListTop; }
+   if (YLast  > YListBot) { YLast  = YListBot; }
+   if (YFirst > YLast) { return; } // edge is entirely clipped
+
+   const int Skip  = YFirst - Y1;        // scan lines to step over
+   const int Count = YLast - YFirst + 1; // scan lines to store
+   HLine* WorkingEdgePointPtr = LineList + (YFirst - YListTop);
+
    int DeltaX = X2 - X1; // X length of the edge
 
    // direction in which X moves (Y2 is always > Y1, so Y always counts up)
@@ -539,17 +836,17 @@ static void ScanEdge(
    int Width = ABS(DeltaX);
    if (Width == 0) { // vertical edge: store same X coordinate for every scan line
       // Scan the edge for each scan line in turn
-      for (int i = Height - SkipFirst; i-- > 0; WorkingEdgePointPtr++) {
+      for (int i = Count; i-- > 0; WorkingEdgePointPtr++) {
          // Store the X coordinate in the appropriate edge list
          if (SetXStart == 1) { WorkingEdgePointPtr->XStart = X1; }
          else                { WorkingEdgePointPtr->XEnd   = X1; }
       }
    } else if (Width == Height) { // diagonal edge: advance X coordinate 1 pixel each scan line
-      // skip the first point if so indicated
-      if (SkipFirst) { X1 += AdvanceAmt; } // move 1 pixel to left or right
+      // skip the first point(s) if so indicated
+      X1 += Skip * AdvanceAmt; // move Skip pixels to left or right
 
       // Scan the edge for each scan line in turn
-      for (int i = Height - SkipFirst; i-- > 0; WorkingEdgePointPtr++) {
+      for (int i = Count; i-- > 0; WorkingEdgePointPtr++) {
          // Store the X coordinate in the appropriate edge list
          if (SetXStart == 1) { WorkingEdgePointPtr->XStart = X1; }
          else                { WorkingEdgePointPtr->XEnd   = X1; }
@@ -560,15 +857,19 @@ static void ScanEdge(
       // If DeltaX >= 0 then initial error term going left to right else right to left
       ErrorTerm = (DeltaX >= 0) ? 0 : (-Height + 1);
 
-      if (SkipFirst) {   /* skip the first point if so indicated */
-         /* Determine whether it's time for the X coord to advance */
-         if ((ErrorTerm += Width) > 0) {
-            X1 += AdvanceAmt; /* move 1 pixel to the left or right */
-            ErrorTerm -= Height; /* advance ErrorTerm to next point */
+      if (Skip) { /* skip the first point(s) if so indicated */
+         // Same as stepping the loop below Skip times: X advances once for
+         // each time the error term crosses above 0
+         int64_t Error = ErrorTerm + (int64_t)Skip * Width;
+         if (Error > 0) {
+            int64_t Steps = (Error + Height - 1) / Height;
+            X1 += (int)Steps * AdvanceAmt;
+            Error -= Steps * Height;
          }
+         ErrorTerm = (int)Error;
       }
       // Scan the edge for each scan line in turn
-      for (int i = Height - SkipFirst; i-- > 0; WorkingEdgePointPtr++) {
+      for (int i = Count; i-- > 0; WorkingEdgePointPtr++) {
          /* Store the X coordinate in the appropriate edge list */
          if (SetXStart == 1) { WorkingEdgePointPtr->XStart = X1; }
          else                { WorkingEdgePointPtr->XEnd   = X1; }
@@ -588,16 +889,20 @@ static void ScanEdge(
       // If DeltaX >= 0 then initial error term going left to right else right to left
       ErrorTerm = (DeltaX >= 0) ? 0 : (-Height + 1);
 
-      if (SkipFirst) {   /* skip the first point if so indicated */
-         X1 += XMajorAdvanceAmt;    /* move X minimum distance */
-         /* Determine whether it's time for X to advance one extra */
-         if ((ErrorTerm += ErrorTermAdvance) > 0) {
-            X1 += AdvanceAmt;       /* move X one more */
-            ErrorTerm -= Height; /* advance ErrorTerm to correspond */
+      if (Skip) { /* skip the first point(s) if so indicated */
+         X1 += Skip * XMajorAdvanceAmt; /* move X minimum distance */
+         // Same as stepping the loop below Skip times: X advances one extra
+         // for each time the error term crosses above 0
+         int64_t Error = ErrorTerm + (int64_t)Skip * ErrorTermAdvance;
+         if (Error > 0) {
+            int64_t Steps = (Error + Height - 1) / Height;
+            X1 += (int)Steps * AdvanceAmt;
+            Error -= Steps * Height;
          }
+         ErrorTerm = (int)Error;
       }
       // Scan the edge for each scan line in turn
-      for (int i = Height - SkipFirst; i-- > 0; WorkingEdgePointPtr++) {
+      for (int i = Count; i-- > 0; WorkingEdgePointPtr++) {
          // Store the X coordinate in the appropriate edge list
          if (SetXStart == 1) { WorkingEdgePointPtr->XStart = X1; }
          else                { WorkingEdgePointPtr->XEnd   = X1; }
@@ -610,8 +915,55 @@ static void ScanEdge(
          }
       }
    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/* Fits the depth plane of a polygon to the vertex depths. The gradients come
+   from the fan triangle (vertex 0, k, k+1) of largest area, which is the one
+   least affected by rounding of vertices to screen coordinates. */
+static void SetupDepthPlane(
+    const Point*   VertexPtr,
+    const int32_t* DepthPtr,
+    int            Length,
+    int XOffset, int YOffset,
+    DepthPlane*    pPlane)
+{
+   int64_t Den  = 0;
+   int     Best = 0;
+   for (int k = 1; k + 1 < Length; k++)
+   {
+      const int64_t D =
+         (int64_t)(VertexPtr[k].X     - VertexPtr[0].X) * (VertexPtr[k + 1].Y - VertexPtr[0].Y) -
+         (int64_t)(VertexPtr[k + 1].X - VertexPtr[0].X) * (VertexPtr[k].Y     - VertexPtr[0].Y);
+      if (ABS(D) > ABS(Den)) { Den = D; Best = k; }
+   }
+
+   if (Den == 0) // degenerate polygon (a line or point): use nearest depth
+   {
+      int32_t Z = DepthPtr[0];
+      for (int k = 1; k < Length; k++) { Z = MAX(Z, DepthPtr[k]); }
+      pPlane->Z0   = Z;
+      pPlane->DZDX = 0;
+      pPlane->DZDY = 0;
+      return;
+   }
 
-   *EdgePointPtr = WorkingEdgePointPtr;   /* advance caller's ptr */
+   // Solve DZ = DZDX * DX + DZDY * DY along both edges from vertex 0
+   const int64_t DX1 = VertexPtr[Best].X     - VertexPtr[0].X;
+   const int64_t DY1 = VertexPtr[Best].Y     - VertexPtr[0].Y;
+   const int64_t DX2 = VertexPtr[Best + 1].X - VertexPtr[0].X;
+   const int64_t DY2 = VertexPtr[Best + 1].Y - VertexPtr[0].Y;
+   const int64_t DZ1 = (int64_t)DepthPtr[Best]     - DepthPtr[0];
+   const int64_t DZ2 = (int64_t)DepthPtr[Best + 1] - DepthPtr[0];
+   int64_t DZDX = (DZ1 * DY2 - DZ2 * DY1) / Den;
+   int64_t DZDY = (DX1 * DZ2 - DX2 * DZ1) / Den;
+   DZDX = MIN(MAX(DZDX, -DEPTH_MAX_GRADIENT), DEPTH_MAX_GRADIENT);
+   DZDY = MIN(MAX(DZDY, -DEPTH_MAX_GRADIENT), DEPTH_MAX_GRADIENT);
+
+   pPlane->DZDX = (int32_t)DZDX;
+   pPlane->DZDY = (int32_t)DZDY;
+   pPlane->Z0   = DepthPtr[0] - DZDX * (VertexPtr[0].X + XOffset)
+                              - DZDY * (VertexPtr[0].Y + YOffset);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -623,7 +975,9 @@ static void ScanEdge(
   right & left edges never cross. (It's OK for them to touch, though,
   so long as the right edge never crosses over to the left of the
   left edge.) Nonconvex polygons won't be drawn properly. Returns 1
-  for success, 0 if memory allocation failed. */
+  for success, 0 if the context's scratch space is too small.
+  With a depth buffer in the context and vertex depths in DepthPtr, depth is
+  interpolated across each scan converted span and tested per pixel. */
 
 /* Advances the index by one vertex forward through the vertex list,
    wrapping at the end of the list */
@@ -648,14 +1002,14 @@ int FillConvexPolygon(
     int32_t          Length,     // number of vertices
     int              Color,
     int XOffset, int YOffset,    // Note: offset only used in fillTest.cpp
-    Canvas*          pCanvas)
+    RasterContext*   pContext,   // canvas, raster op, clip and scratch
+    const int32_t*   DepthPtr)   // depth of each vertex, nullptr = no depth test
 {
   int i, MinIndexL, MaxIndex, MinIndexR, SkipFirst;
   int MinPoint_Y, MaxPoint_Y, LeftEdgeDir;
   int NextIndex, CurrentIndex, PreviousIndex;
   int DeltaXN, DeltaYN, DeltaXP, DeltaYP;
   HLineList WorkingHLineList;
-  HLine *EdgePointPtr;
 
   /* Scan the list to find the top and bottom of the polygon */
   if (Length == 0) { return 1; } /* reject null polygons */
@@ -717,34 +1071,38 @@ int FillConvexPolygon(
      in that case the top vertex has a right edge component, and set
      the top scan line to draw, which is likewise the second line of
      the polygon unless the top is flat */
-  if ((WorkingHLineList.Length = MaxPoint_Y - MinPoint_Y - 1 + TopIsFlat) <= 0)
+  int Length_Y = MaxPoint_Y - MinPoint_Y - 1 + TopIsFlat;
+  if (Length_Y <= 0)
   {
      return(1);  /* there's nothing to draw, so we're done */
   }
-  if (WorkingHLineList.Length > MAX_SCREEN_HEIGHT)
+  int YStart = YOffset + MinPoint_Y + 1 - TopIsFlat;
+  int YEnd   = YStart + Length_Y - 1;
+
+  // Clip scan lines to the canvas and to the caller's Y range so only
+  // visible lines are scan converted and drawn
+  const int Height = pContext->pCanvas->Height();
+  if (YStart < pContext->YClipMin) { YStart = pContext->YClipMin; }
+  if (YEnd   > pContext->YClipMax) { YEnd   = pContext->YClipMax; }
+  if (YStart < 0)                  { YStart = 0; }
+  if (YEnd   > Height - 1)         { YEnd   = Height - 1; }
+  if (YStart > YEnd) { return 1; } // poly is off screen or outside clip range
+
+  // Clipped lines always fit in the context's scratch (one entry per canvas row)
+  WorkingHLineList.YStart   = YStart;
+  WorkingHLineList.Length   = YEnd - YStart + 1;
+  WorkingHLineList.HLinePtr = pContext->HLines.data();
+  if (WorkingHLineList.Length > (int32_t)pContext->HLines.size())
   {
-      return 0; // will exceed WorkingHLineList.HLinePtr[MAX_SCREEN_HEIGHT]
+      return 0; // context was created for a smaller canvas
   }
-  WorkingHLineList.YStart = YOffset + MinPoint_Y + 1 - TopIsFlat;
-
-  if (WorkingHLineList.YStart >= pCanvas->Height()) { return 1; } // poly is off screen
-
-  const int YEnd = WorkingHLineList.YStart + WorkingHLineList.Length - 1;
-  if (YEnd < 0) { return 1; } // poly is off screen
 
-  /* Commented out in favor of fixed size array to avoid malloc and free
-  // Get memory in which to store the line list we generate
-  if ((WorkingHLineList.HLinePtr =
-        (HLine *)(malloc(sizeof(HLine) *
-        WorkingHLineList.Length))) == NULL)
-  {
-     return(0);  // couldn't get memory for the line list
-  }
-  */
+  // scan lines held by WorkingHLineList in (un-offset) vertex coordinates
+  const int YListTop = YStart - YOffset;
+  const int YListBot = YEnd   - YOffset;
 
   /* Scan the left edge and store the boundary points in the list */
   /* Initial pointer for storing scan converted left-edge coords */
-  EdgePointPtr = WorkingHLineList.HLinePtr;
   PreviousIndex = CurrentIndex = MinIndexL; // Start from top of left edge
   /* Skip the first point of the first line unless the top is flat;
      if the top isn't flat, the top vertex is exactly on a right
@@ -756,13 +1114,13 @@ int FillConvexPolygon(
      ScanEdge(VertexPtr[PreviousIndex].X + XOffset,
               VertexPtr[PreviousIndex].Y,
               VertexPtr[CurrentIndex].X + XOffset,
-              VertexPtr[CurrentIndex].Y, 1, SkipFirst, &EdgePointPtr);
+              VertexPtr[CurrentIndex].Y, 1, SkipFirst,
+              WorkingHLineList.HLinePtr, YListTop, YListBot);
      PreviousIndex = CurrentIndex;
      SkipFirst = 0; /* scan convert the first point from now on */
   } while (CurrentIndex != MaxIndex);
 
   /* Scan the right edge and store the boundary points in the list */
-  EdgePointPtr = WorkingHLineList.HLinePtr;
   PreviousIndex = CurrentIndex = MinIndexR;
   SkipFirst = TopIsFlat ? 0 : 1;
   /* Scan convert the right edge, top to bottom. X coordinates are
@@ -773,103 +1131,55 @@ int FillConvexPolygon(
      ScanEdge(VertexPtr[PreviousIndex].X + XOffset - 1,
               VertexPtr[PreviousIndex].Y,
               VertexPtr[CurrentIndex].X + XOffset - 1,
-              VertexPtr[CurrentIndex].Y, 0, SkipFirst, &EdgePointPtr);
+              VertexPtr[CurrentIndex].Y, 0, SkipFirst,
+              WorkingHLineList.HLinePtr, YListTop, YListBot);
      PreviousIndex = CurrentIndex;
      SkipFirst = 0; /* scan convert the first point from now on */
   } while (CurrentIndex != MaxIndex);
 
   /* Draw the line list representing the scan converted polygon */
-  DrawHorizontalLineList(&WorkingHLineList, Color, pCanvas);
-
-  /* Release the line list's memory and we're successfully done */
-  //free(WorkingHLineList.HLinePtr);
+  if ((pContext->pDepth != nullptr) && (DepthPtr != nullptr))
+  {
+     DepthPlane Plane;
+     SetupDepthPlane(VertexPtr, DepthPtr, Length, XOffset, YOffset, &Plane);
+     DrawHorizontalLineList(&WorkingHLineList, Color, &Plane, pContext);
+  }
+  else
+  {
+     DrawHorizontalLineList(&WorkingHLineList, Color, nullptr, pContext);
+  }
 
   return(1);
 }
 
-/*
 ////////////////////////////////////////////////////////////////////////////////
-// Set up empty object list, with sentinels at both ends to terminate searches
-void InitializeObjectList()
+// Resorts the objects in order of ascending center Z coordinate in view space
+// (back to front), by moving each object in turn back to its correct position
+// in the list. Replaces Abrash's linked list version with an array so there is
+// nothing to allocate or link per object.
+void SortObjects(
+    PObject** ObjectList,
+    int32_t   NumObjects)
 {
-   ObjectListStart.NextObject     = &ObjectListEnd;
-   ObjectListStart.PreviousObject = NULL;
-   ObjectListStart.CenterInView.Z = INT_TO_FIXED(-32768);
-
-   ObjectListEnd.NextObject       = NULL;
-   ObjectListEnd.PreviousObject   = &ObjectListStart;
-   ObjectListEnd.CenterInView.Z   = 0x7FFFFFFFL;
-
-   NumObjects = 0;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-// Adds an object to the object list, sorted by center Z coord.
-void AddObject(Object *ObjectPtr)
-{
-   Object *ObjectListPtr = ObjectListStart.NextObject;
-
-   // Find the insertion point. Guaranteed to terminate because of the end sentinel
-   while (ObjectPtr->CenterInView.Z > ObjectListPtr->CenterInView.Z) {
-      ObjectListPtr = ObjectListPtr->NextObject;
-   }
-
-   // Link in the new object
-   ObjectListPtr->PreviousObject->NextObject = ObjectPtr;
-   ObjectPtr->NextObject = ObjectListPtr;
-   ObjectPtr->PreviousObject = ObjectListPtr->PreviousObject;
-   ObjectListPtr->PreviousObject = ObjectPtr;
-   NumObjects++;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-// Resorts the objects in order of ascending center Z coordinate in view space,
-// by moving each object in turn to the correct position in the object list.
-void SortObjects()
-{
-   int i;
-   Object *ObjectPtr, *ObjectCmpPtr, *NextObjectPtr;
-
-   // Start checking with the second object
-   ObjectCmpPtr = ObjectListStart.NextObject;
-   ObjectPtr = ObjectCmpPtr->NextObject;
-   for (i=1; i<NumObjects; i++) {
-      // See if we need to move backward through the list
-      if (ObjectPtr->CenterInView.Z < ObjectCmpPtr->CenterInView.Z) {
-         // Remember where to resume sorting with the next object
-         NextObjectPtr = ObjectPtr->NextObject;
-
-         // Yes, move backward until we find the proper insertion
-         // point. Termination guaranteed because of start sentinel
-         do {
-            ObjectCmpPtr = ObjectCmpPtr->PreviousObject;
-         } while (ObjectPtr->CenterInView.Z <
-               ObjectCmpPtr->CenterInView.Z);
-
-         // Now move the object to its new location
-         // Unlink the object at the old location
-         ObjectPtr->PreviousObject->NextObject =
-               ObjectPtr->NextObject;
-         ObjectPtr->NextObject->PreviousObject =
-               ObjectPtr->PreviousObject;
-
-         // Link in the object at the new location
-         ObjectCmpPtr->NextObject->PreviousObject = ObjectPtr;
-         ObjectPtr->PreviousObject = ObjectCmpPtr;
-         ObjectPtr->NextObject = ObjectCmpPtr->NextObject;
-         ObjectCmpPtr->NextObject = ObjectPtr;
-
-         // Advance to the next object to sort
-         ObjectCmpPtr = NextObjectPtr->PreviousObject;
-         ObjectPtr = NextObjectPtr;
-      } else {
-         // Advance to the next object to sort
-         ObjectCmpPtr = ObjectPtr;
-         ObjectPtr = ObjectPtr->NextObject;
-      }
+   for (int i = 1; i < NumObjects; i++)
+   {
+      PObject*         ObjectPtr = ObjectList[i];
+      const Fixedpoint Z         = ObjectPtr->CenterInView.Z;
+
+      // Already in place (the common case when the order is unchanged from
+      // last frame)
+      if (ObjectList[i - 1]->CenterInView.Z <= Z) { continue; }
+
+      // Move backward until we find the proper insertion point, shifting
+      // farther objects up one place
+      int j = i;
+      do {
+         ObjectList[j] = ObjectList[j - 1];
+         j--;
+      } while ((j > 0) && (ObjectList[j - 1]->CenterInView.Z > Z));
+      ObjectList[j] = ObjectPtr;
    }
 }
-*/
 
 ////////////////////////////////////////////////////////////////////////////////
 // Compute screen coordinates based on a physically-based camera model
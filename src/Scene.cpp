@@ -0,0 +1,352 @@
+/* Rotating cubes and cow scene. Uses fixed point. All C code tested with
+   Borland C++ in C compilation mode and the small model. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <algorithm> // std::min()
+
+#include "Scene.h"
+#include "DepthBuffer.h"
+#include "cow.h"
+
+#define NUM_CUBE_VERTS  8 /* # of vertices per cube */
+#define NUM_CUBE_FACES  6 /* # of faces per cube */
+
+int NumObjects = 0;
+int RecalcAllXforms = 1;
+
+//Xform WorldViewXform;           // initialized from floats
+PObject* ObjectList[NUM_CUBES];   // pointers to objects
+Point3 CubeVerts[NUM_CUBE_VERTS]; // set elsewhere, from floats
+
+#ifndef ARRAYSIZE
+#define ARRAYSIZE(x) (sizeof(x) / sizeof(x[0]))
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Transform from world space into view space (no transformation, currently)
+void InitializeFixedPoint()
+{
+    /*
+    int IntWorldViewXform[3][4] = {{1,0,0,0},
+                                   {0,1,0,0},
+                                   {0,0,1,0}};
+    for (int i=0; i<3; i++)
+        for (int j=0; j<4; j++)
+            WorldViewXform[i][j] = INT_TO_FIXED(IntWorldViewXform[i][j]);
+            */
+
+    // All vertices in the basic cube
+    static IntPoint3 IntCubeVerts[NUM_CUBE_VERTS] = {
+        {15,15,15}, {15,15,-15}, {15,-15,15}, {15,-15,-15},
+       {-15,15,15},{-15,15,-15},{-15,-15,15},{-15,-15,-15} };
+
+    for (int i=0; i < NUM_CUBE_VERTS; i++) {
+        CubeVerts[i].X = INT_TO_FIXED(IntCubeVerts[i].X);
+        CubeVerts[i].Y = INT_TO_FIXED(IntCubeVerts[i].Y);
+        CubeVerts[i].Z = INT_TO_FIXED(IntCubeVerts[i].Z);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Initializes the cubes and adds them to the object list.
+
+// vertex indices for individual cube faces
+static int Face1[] = {1,3,2,0};
+static int Face2[] = {5,7,3,1};
+static int Face3[] = {4,5,1,0};
+static int Face4[] = {3,7,6,2};
+static int Face5[] = {5,4,6,7};
+static int Face6[] = {0,2,6,4};
+
+static int *VertNumList[] = { Face1, Face2, Face3, Face4, Face5, Face6 };
+
+static int VertsInFace[]={
+    ARRAYSIZE(Face1),
+    ARRAYSIZE(Face2),
+    ARRAYSIZE(Face3),
+    ARRAYSIZE(Face4),
+    ARRAYSIZE(Face5),
+    ARRAYSIZE(Face6) };
+
+/* X, Y, Z rotations for cubes */
+#define ROT_6  INT_TO_FIXED(3)  /* rotate 6 degrees at a time */
+#define ROT_3  INT_TO_FIXED(2)  /* rotate 3 degrees at a time */
+#define ROT_2  INT_TO_FIXED(1)  /* rotate 2 degrees at a time */
+
+static RotateControl InitialRotate[NUM_CUBES] = {
+   {     0, ROT_6, ROT_6},
+   { ROT_3,     0, ROT_3},
+   { ROT_3, ROT_3,     0},
+   { ROT_3,-ROT_3,     0},
+   {-ROT_3, ROT_2,     0},
+   {-ROT_6,-ROT_3,     0},
+   { ROT_3,     0,-ROT_6},
+   {-ROT_2,     0, ROT_3},
+   {-ROT_3,     0,-ROT_3},
+   {     0, ROT_2,-ROT_2},
+   {     0,-ROT_3, ROT_3},
+   { ROT_2, ROT_2, ROT_2} };
+
+const Fixedpoint minX = -200;
+const Fixedpoint maxX =  200;
+
+const Fixedpoint minY = -100;
+const Fixedpoint maxY =  100;
+
+const Fixedpoint minZ = -1100;
+const Fixedpoint maxZ =  -350;
+
+//static MoveControl InitialMove = {2,1,10, minX,minY,minZ, maxX,maxY,maxZ};
+static MoveControl InitialMove = {0,0,0, minX,minY,minZ, maxX,maxY,maxZ};
+
+/* starting coordinates for cubes in world space */
+static int CubeStartCoords[NUM_CUBES][3] = {
+   {100,  0,-350},
+   {100, 70,-350},
+   {100,-70,-350},
+
+   { 33,  0,-350},
+   { 33, 70,-350},
+   { 33,-70,-350},
+   {-33,  0,-350},
+   {-33, 70,-350},
+   {-33,-70,-350},
+
+   {-100,  0,-350},
+   {-100, 70,-350},
+   {-100,-70,-350}};
+
+/* delay counts (speed control) for cubes */
+static int InitRDelayCounts[NUM_CUBES] = {1,2,1,2,1,1,1,1,1,2,1,1};
+static int BaseRDelayCounts[NUM_CUBES] = {4,8,4,8,8,4,4,4,8,8,8,4};
+static int InitMDelayCounts[NUM_CUBES] = {1,1,1,1,1,1,1,1,1,1,1,1};
+static int BaseMDelayCounts[NUM_CUBES] = {9,9,9,9,9,9,9,9,9,9,9,9};
+
+void InitializeCubes()
+{
+   int i, j, k;
+   PObject *WorkingCube;
+
+   for (i=0; i < NUM_CUBES; i++) {
+      if ((WorkingCube = (PObject*)calloc(1, sizeof(PObject))) == NULL)
+      {
+         printf("Couldn't get memory\n");
+         exit(1);
+      }
+
+      WorkingCube->DrawFunc    = DrawPObject;
+      WorkingCube->RecalcFunc  = XformAndProjectPObject;
+      WorkingCube->MoveFunc    = RotateAndMovePObject;
+      WorkingCube->RecalcXform = 1;
+
+      WorkingCube->RDelayCount     = InitRDelayCounts[i];
+      WorkingCube->RDelayCountBase = BaseRDelayCounts[i];
+
+      WorkingCube->MDelayCount     = InitMDelayCounts[i];
+      WorkingCube->MDelayCountBase = BaseMDelayCounts[i];
+
+      /* Set the object->world xform to none */
+      for (j=0; j<3; j++)
+         for (k=0; k<4; k++)
+            WorkingCube->XformToWorld[j][k] = INT_TO_FIXED(0);
+
+      WorkingCube->XformToWorld[0][0] =
+         WorkingCube->XformToWorld[1][1] =
+         WorkingCube->XformToWorld[2][2] = INT_TO_FIXED(1);
+
+      /* Set the initial location */
+      for (j=0; j<3; j++)
+      {
+          WorkingCube->XformToWorld[j][3] = INT_TO_FIXED(CubeStartCoords[i][j]);
+      }
+
+      if (i < NUM_CUBES - 1)
+      {
+          WorkingCube->NumVerts   = NUM_CUBE_VERTS;
+          WorkingCube->VertexList = CubeVerts;
+          WorkingCube->NumFaces   = NUM_CUBE_FACES;
+          WorkingCube->Rotate     = InitialRotate[i];
+          WorkingCube->Move.MoveX = INT_TO_FIXED(InitialMove.MoveX);
+          WorkingCube->Move.MoveY = INT_TO_FIXED(InitialMove.MoveY);
+          WorkingCube->Move.MoveZ = INT_TO_FIXED(InitialMove.MoveZ);
+
+          WorkingCube->Move.MinX  = INT_TO_FIXED(InitialMove.MinX);
+          WorkingCube->Move.MinY  = INT_TO_FIXED(InitialMove.MinY);
+          WorkingCube->Move.MinZ  = INT_TO_FIXED(InitialMove.MinZ);
+
+          WorkingCube->Move.MaxX  = INT_TO_FIXED(InitialMove.MaxX);
+          WorkingCube->Move.MaxY  = INT_TO_FIXED(InitialMove.MaxY);
+          WorkingCube->Move.MaxZ  = INT_TO_FIXED(InitialMove.MaxZ);
+
+          WorkingCube->XformedVertexList   = (Point3*)malloc(NUM_CUBE_VERTS*sizeof(Point3));
+          WorkingCube->ProjectedVertexList = (Point3*)malloc(NUM_CUBE_VERTS*sizeof(Point3));
+          WorkingCube->ScreenVertexList    = (Point* )malloc(NUM_CUBE_VERTS*sizeof(Point ));
+          WorkingCube->FaceList            = (Face*  )malloc(NUM_CUBE_FACES*sizeof(Face  ));
+
+          /* Initialize object faces */
+          for (j=0; j < NUM_CUBE_FACES; j++) {
+             WorkingCube->FaceList[j].VertNums = VertNumList[j];
+             WorkingCube->FaceList[j].NumVerts = VertsInFace[j];
+             WorkingCube->FaceList[j].Color    = rand() & 0xFFu; // random colors
+          }
+      }
+      else // else setup the cow object
+      {
+          int32_t NumVerts = ARRAYSIZE(cow_vertices);
+          int32_t NumFaces = ARRAYSIZE(cow_nvertices) / 3; // = 3156
+          WorkingCube->NumVerts = NumVerts;
+          WorkingCube->NumFaces = NumFaces;
+
+          // Convert floating point vertices to fixed point
+          Point3* vertices = (Point3*)malloc(NumVerts * sizeof(Point3));
+          for (j=0; j < NumVerts; j++)
+          {
+              vertices[j].X = DOUBLE_TO_FIXED(cow_vertices[j].X * 5.0);
+              vertices[j].Y = DOUBLE_TO_FIXED(cow_vertices[j].Y * 5.0);
+              vertices[j].Z = DOUBLE_TO_FIXED(cow_vertices[j].Z * 5.0);
+          }
+
+          WorkingCube->VertexList = vertices; // point Point3* to array of Point3
+
+          WorkingCube->Rotate     = InitialRotate[i];
+          WorkingCube->Move.MoveX = INT_TO_FIXED(InitialMove.MoveX);
+          WorkingCube->Move.MoveY = INT_TO_FIXED(InitialMove.MoveY);
+          WorkingCube->Move.MoveZ = INT_TO_FIXED(InitialMove.MoveZ);
+
+          WorkingCube->Move.MinX  = INT_TO_FIXED(InitialMove.MinX);
+          WorkingCube->Move.MinY  = INT_TO_FIXED(InitialMove.MinY);
+          WorkingCube->Move.MinZ  = INT_TO_FIXED(InitialMove.MinZ);
+
+          WorkingCube->Move.MaxX  = INT_TO_FIXED(InitialMove.MaxX);
+          WorkingCube->Move.MaxY  = INT_TO_FIXED(InitialMove.MaxY);
+          WorkingCube->Move.MaxZ  = INT_TO_FIXED(InitialMove.MaxZ);
+
+          WorkingCube->XformedVertexList   = (Point3*)malloc(NumVerts*sizeof(Point3));
+          WorkingCube->ProjectedVertexList = (Point3*)malloc(NumVerts*sizeof(Point3));
+          WorkingCube->ScreenVertexList    = (Point* )malloc(NumVerts*sizeof(Point ));
+          WorkingCube->FaceList            = (Face*  )malloc(NumFaces*sizeof(Face  ));
+
+          // Initialize the object faces
+          for (j=0; j < NumFaces; j++) {
+             WorkingCube->FaceList[j].VertNums = &cow_nvertices[j * 3];
+             WorkingCube->FaceList[j].NumVerts = 3;
+             WorkingCube->FaceList[j].Color    = rand() & 0xFFu; // random colors
+          }
+      }
+      ObjectList[NumObjects++] = WorkingCube;
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw all objects (and optional grid) to rows YMin thru YMax of canvas.
+// Called by each worker of the pool for its own band of rows with its own
+// raster context, so bands are drawn in parallel with no shared writes.
+void RenderBand(
+    PObject*       ObjectList[NUM_CUBES],
+    RasterContext& context,
+    int32_t        YMin,
+    int32_t        YMax,
+    bool           enableGrid)
+{
+    int i;
+    Canvas& canvas = *context.pCanvas;
+    if (YMin > YMax) { return; } // empty band
+
+    // clear band prior to render
+    for (int32_t Y = YMin; Y <= YMax; ++Y) { canvas.FillSpan(0, canvas.Width() - 1, Y, 0u); }
+    if (context.pDepth) { context.pDepth->ClearRows(YMin, YMax); }
+
+    // Draw all objects to framebuffer. The list is sorted back to front so
+    // without a z-buffer nearer objects paint over farther ones. With a
+    // z-buffer draw front to back so hidden objects are rejected early.
+    context.Rop      = RASTER_SET;
+    context.YClipMin = YMin;
+    context.YClipMax = YMax;
+    for (i=0; i < NumObjects; i++)
+    {
+        PObject* Object = context.pDepth ? ObjectList[NumObjects - 1 - i] : ObjectList[i];
+        Object->DrawFunc(Object, &context);
+    }
+
+    if (enableGrid)
+    {
+        // Define thin rectangle for use as a line to draw a grid
+        const int32_t lineWidth = 1;
+        const int width  = canvas.Width();
+        const int height = canvas.Height();
+        Point horzLine[] = {{0,0}, {width-1, 0},
+                                   {width-1, lineWidth}, {0, lineWidth}};
+        Point vertLine[] = {{0,0}, {lineWidth,              0},
+                                   {lineWidth, height-1}, {0, height-1}};
+        assert(ARRAYSIZE(horzLine) == 4);
+
+        // Draw grid lines to show lens distortion
+        for (i = 0; i < 7; ++i)
+        {
+            FillConvexPolygon(horzLine, ARRAYSIZE(horzLine), 200, 0, i * (height - 1) / 6, &context);
+        }
+        for (i = 0; i < 10; ++i)
+        {
+            FillConvexPolygon(vertLine, ARRAYSIZE(vertLine), 200, i * (width - 1) / 9, 0, &context);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void Render(
+    PObject*                    ObjectList[NUM_CUBES],
+    Canvas&                     canvas,
+    WorkerPool&                 pool,
+    std::vector<RasterContext>& contexts, // one per worker
+    bool                        enableGrid)
+{
+    Fixedpoint nearClipZ = DOUBLE_TO_FIXED(-2.0);
+
+    // For each object, update position and orientation
+    int i;
+    for (i=0; i < NumObjects; i++) {
+       if (ObjectList[i]->RecalcXform || RecalcAllXforms) {
+          ObjectList[i]->RecalcFunc(ObjectList[i], &canvas, nearClipZ);
+          ObjectList[i]->RecalcXform = 0;
+       }
+    }
+    RecalcAllXforms = 0; // disable 1-shot start-up recalculating
+
+    // Sort by depth, mostly already in order from last frame
+    SortObjects(ObjectList, NumObjects);
+
+    // Split canvas into one horizontal band per worker and draw them in
+    // parallel, at least one row per band
+    const int32_t height   = canvas.Height();
+    const int32_t numBands = std::min(pool.NumWorkers(), height);
+    pool.Run([&](int32_t band)
+    {
+        if (band >= numBands) { return; } // more workers than rows
+        const int32_t YMin = band       * height / numBands;
+        const int32_t YMax = (band + 1) * height / numBands - 1;
+        RenderBand(ObjectList, contexts[band], YMin, YMax, enableGrid);
+    });
+
+    // Move and reorient each object for next iteration
+    for (i=0; i < NumObjects; i++) { ObjectList[i]->MoveFunc(ObjectList[i]); }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void FreeCubes()
+{
+    for (int i = 0; i < NumObjects; ++i)
+    {
+        // TODO: switch to use std::vector rather than malloc/free
+        PObject* Object = ObjectList[i];
+        if (Object->VertexList != CubeVerts) { free(Object->VertexList); } // cow
+        free(Object->XformedVertexList);
+        free(Object->ProjectedVertexList);
+        free(Object->ScreenVertexList);
+        free(Object->FaceList);
+        free(Object);
+        ObjectList[i] = nullptr;
+    }
+    NumObjects      = 0;
+    RecalcAllXforms = 1;
+}
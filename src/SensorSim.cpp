@@ -0,0 +1,284 @@
+/* Headless version of CubeTest: renders the rotating cubes and cow scene,
+   simulates the lens and sensor with SpadSim and streams the frames to a
+   file or pipe (e.g. "SensorSim -o - | ffmpeg ..."). Runs without a display
+   so it builds on any platform with a C++14 compiler. */
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>  // strcmp()
+#include <string>
+#include <vector>
+#include <algorithm> // std::min(), std::max()
+
+#if defined(_WIN32)
+#include <io.h>      // _setmode()
+#include <fcntl.h>   // _O_BINARY
+#else
+#include <signal.h>  // signal()
+#endif
+
+#include "RenderFXP.h"
+#include "CanvasT.h"
+#include "SpadSim.h"
+#include "WorkerPool.h"
+#include "DepthBuffer.h"
+#include "Scene.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Command line options
+struct Options
+{
+    int32_t  width      = 1008;
+    int32_t  height     =  768;
+    int32_t  numFrames  =  256;
+    uint32_t firstFrame =    0;    // SpadSim frame number of first frame
+    int32_t  numThreads =    0;    // render threads, 0 = one per hardware thread
+    uint32_t stages     = SpadSim::STAGE_LENS_DIST | SpadSim::STAGE_BILINEAR |
+                          SpadSim::STAGE_BLUR | SpadSim::STAGE_DF;
+    SpadSim::OutputFormat format = SpadSim::OUTPUT_GRAY8;
+    bool     enableGrid = false;
+    const char* pOutput = nullptr; // output file, "-" = stdout, null = none
+};
+
+static const char* const FormatNames[SpadSim::NUM_OUTPUT_FORMATS] =
+    { "bgrx", "gray8", "gray16", "raw10", "raw12" };
+
+////////////////////////////////////////////////////////////////////////////////
+static void Usage(void)
+{
+    fprintf(stderr,
+        "Usage: SensorSim [options]\n"
+        "  -w, --width N      frame width, multiple of 4 (default 1008)\n"
+        "  -h, --height N     frame height, even (default 768)\n"
+        "  -n, --frames N     number of frames (default 256)\n"
+        "  -f, --first N      sensor frame number of first frame (default 0)\n"
+        "  -t, --threads N    render threads, 0 = one per hardware thread (default 0)\n"
+        "  -s, --stages LIST  comma separated stages of lens, bilinear, blur, df,\n"
+        "                     pwl, or none (default lens,bilinear,blur,df)\n"
+        "  -F, --format FMT   output format bgrx, gray8, gray16, raw10 or raw12\n"
+        "                     (default gray8)\n"
+        "  -g, --grid         draw grid lines to show lens distortion\n"
+        "  -o, --output FILE  write frames to FILE, - for stdout (default none)\n"
+        "Timing stats are written to stderr.\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Parse comma separated list of stages, returns false for unknown stage
+static bool ParseStages(const char* pList, uint32_t& stages)
+{
+    static const struct { const char* pName; uint32_t stage; } StageNames[] = {
+        { "lens",     SpadSim::STAGE_LENS_DIST },
+        { "bilinear", SpadSim::STAGE_BILINEAR  },
+        { "blur",     SpadSim::STAGE_BLUR      },
+        { "df",       SpadSim::STAGE_DF        },
+        { "pwl",      SpadSim::STAGE_PWL       },
+        { "none",     0u                       } };
+
+    stages = 0;
+    std::string list(pList);
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) { end = list.size(); }
+        const std::string name = list.substr(start, end - start);
+
+        bool found = false;
+        for (size_t i = 0; i < sizeof(StageNames) / sizeof(StageNames[0]); ++i)
+        {
+            if (name == StageNames[i].pName) { stages |= StageNames[i].stage; found = true; }
+        }
+        if (!found) { return false; }
+        start = end + 1;
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Parse command line, returns false for bad arguments
+static bool ParseArgs(int argc, char* argv[], Options& opts)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* pArg   = argv[i];
+        const char* pValue = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        auto Is = [pArg](const char* pShort, const char* pLong)
+        {
+            return (strcmp(pArg, pShort) == 0) || (strcmp(pArg, pLong) == 0);
+        };
+
+        if (Is("-g", "--grid")) { opts.enableGrid = true; continue; }
+        if (Is("-?", "--help")) { return false; }
+        if (pValue == nullptr)
+        {
+            fprintf(stderr, "Missing value of %s\n", pArg);
+            return false;
+        }
+        ++i; // remaining options have a value
+
+        if      (Is("-w", "--width"))   { opts.width      = atoi(pValue); }
+        else if (Is("-h", "--height"))  { opts.height     = atoi(pValue); }
+        else if (Is("-n", "--frames"))  { opts.numFrames  = atoi(pValue); }
+        else if (Is("-f", "--first"))   { opts.firstFrame = (uint32_t)strtoul(pValue, nullptr, 0); }
+        else if (Is("-t", "--threads")) { opts.numThreads = atoi(pValue); }
+        else if (Is("-o", "--output"))  { opts.pOutput    = pValue; }
+        else if (Is("-s", "--stages"))
+        {
+            if (!ParseStages(pValue, opts.stages))
+            {
+                fprintf(stderr, "Unknown stage in %s\n", pValue);
+                return false;
+            }
+        }
+        else if (Is("-F", "--format"))
+        {
+            uint32_t format = 0;
+            while ((format < SpadSim::NUM_OUTPUT_FORMATS) && (strcmp(pValue, FormatNames[format]) != 0)) { ++format; }
+            if (format == SpadSim::NUM_OUTPUT_FORMATS)
+            {
+                fprintf(stderr, "Unknown format %s\n", pValue);
+                return false;
+            }
+            opts.format = (SpadSim::OutputFormat)format;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", pArg);
+            return false;
+        }
+    }
+
+    // the lens distortion tables need even width and height, and RAW10 packs
+    // 4 pixels
+    if ((opts.width < 4) || ((opts.width & 0x3) != 0) || (opts.width > 65536) ||
+        (opts.height < 2) || ((opts.height & 0x1) != 0) || (opts.numFrames < 0))
+    {
+        fprintf(stderr, "Bad frame size %d x %d or frame count %d\n", opts.width, opts.height, opts.numFrames);
+        return false;
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Min, max and mean of per-frame times
+struct TimeStats
+{
+    double minMs = 1e30;
+    double maxMs = 0.0;
+    double sumMs = 0.0;
+
+    void Add(double ms)
+    {
+        minMs  = std::min(minMs, ms);
+        maxMs  = std::max(maxMs, ms);
+        sumMs += ms;
+    }
+    void Print(const char* pName, int32_t numFrames) const
+    {
+        if (numFrames == 0) { return; }
+        fprintf(stderr, "%-8s mean %8.3f ms  min %8.3f ms  max %8.3f ms\n",
+            pName, sumMs / numFrames, minMs, maxMs);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char* argv[])
+{
+    Options opts;
+    if (!ParseArgs(argc, argv, opts))
+    {
+        Usage();
+        return 1;
+    }
+
+#if !defined(_WIN32)
+    // a closed pipe (e.g. "SensorSim -o - | head -c 1000") fails fwrite()
+    // rather than killing the process, so the stats are still printed
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    // open output
+    FILE* pFile = nullptr;
+    if (opts.pOutput != nullptr)
+    {
+        if (strcmp(opts.pOutput, "-") == 0)
+        {
+            pFile = stdout;
+#if defined(_WIN32)
+            _setmode(_fileno(stdout), _O_BINARY); // no CR/LF conversion
+#endif
+        }
+        else if ((pFile = fopen(opts.pOutput, "wb")) == nullptr)
+        {
+            fprintf(stderr, "Couldn't open %s\n", opts.pOutput);
+            return 1;
+        }
+    }
+
+    const int32_t width  = opts.width;
+    const int32_t height = opts.height;
+
+    // same pipeline as CubeTest with the window replaced by an output frame
+    Canvas16 renderCanvas(width, height);   // 3D to 2D rendering
+    SpadSim       spadSim(width, height);   // lens distortion, dark frame, noise, etc
+    WorkerPool             pool(opts.numThreads); // persistent threads for band rendering
+    DepthBuffer depthBuffer(width, height, INT_TO_FIXED(100)); // 1 m is nearest
+
+    std::vector<RasterContext> contexts(pool.NumWorkers(), RasterContext(&renderCanvas));
+    for (size_t i = 0; i < contexts.size(); ++i) { contexts[i].pDepth = &depthBuffer; }
+
+    const size_t frameBytes = spadSim.OutputRowBytes(opts.format) * height;
+    std::vector<uint8_t> outFrame(frameBytes);
+
+    InitializeFixedPoint(); /* set up fixed-point data */
+    InitializeCubes();      /* set up cubes and add them to object list */
+
+    fprintf(stderr, "%d x %d, %d frames, stages 0x%02x, %s, %d render threads\n",
+        width, height, opts.numFrames, opts.stages, FormatNames[opts.format], pool.NumWorkers());
+
+    typedef std::chrono::high_resolution_clock Clock;
+    auto Ms = [](Clock::time_point t0, Clock::time_point t1)
+    {
+        return std::chrono::duration<double, std::milli>(t1 - t0).count();
+    };
+
+    TimeStats renderStats, sensorStats, writeStats;
+    const uint16_t* pRd = (const uint16_t*)renderCanvas.GetFrameBuffer();
+    spadSim.SetFrame(opts.firstFrame);
+    int32_t frame = 0;
+    const auto tStart = Clock::now();
+    for (; frame < opts.numFrames; ++frame)
+    {
+        const auto t0 = Clock::now();
+        Render(ObjectList, renderCanvas, pool, contexts, opts.enableGrid);
+
+        const auto t1 = Clock::now();
+        spadSim.AddDistortionFormat(pRd, outFrame.data(), opts.stages, opts.format);
+
+        const auto t2 = Clock::now();
+        if (pFile && (fwrite(outFrame.data(), 1, frameBytes, pFile) != frameBytes))
+        {
+            fprintf(stderr, "Write failed at frame %d\n", frame); // e.g. closed pipe
+            break;
+        }
+        const auto t3 = Clock::now();
+
+        renderStats.Add(Ms(t0, t1));
+        sensorStats.Add(Ms(t1, t2));
+        writeStats .Add(Ms(t2, t3));
+    }
+    const double totalMs = Ms(tStart, Clock::now());
+
+    renderStats.Print("render", frame);
+    sensorStats.Print("sensor", frame);
+    if (pFile) { writeStats.Print("write", frame); }
+    if (frame > 0)
+    {
+        fprintf(stderr, "total    %.1f ms, %.1f fps, %.1f MB/s output\n", totalMs,
+            frame / (totalMs / 1000.0), (double)frameBytes * frame / (totalMs * 1000.0));
+    }
+
+    FreeCubes();
+    if (pFile && (pFile != stdout)) { fclose(pFile); }
+    return (frame == opts.numFrames) ? 0 : 1;
+}
@@ -1,51 +1,117 @@
-#include <cstdlib>   // rand()
-#include <math.h>    // expf()
+#include <math.h>    // expf(), logf(), log1pf(), lgammaf()
 
 #include "random.h"
 #include "memory.h"  // memset()
 
 ////////////////////////////////////////////////////////////////////////////////
-// Approximation to unit normal distribution.
-// Returns number in range: -6.0 <= x <= 6.0
-// Note: in a true unit normal distribution, only 0.00034% of samples fall outside 6.
-static float IrwinHallDist(void)
+// Tables of the Ziggurat method for the unit normal distribution from:
+// Marsaglia & Tsang, "The Ziggurat Method for Generating Random Variables",
+// Journal of Statistical Software, 2000. The density is covered by 128
+// layers of equal area, a sample is accepted without further work ~99% of
+// the time.
+struct Ziggurat
 {
-    // Get sum of 12 numbers randomly drawn from range [0, RAND_MAX]
-    // Note: potential overflow of sum will bias final output to smaller values
-    // Note: loop unrolled for speed
-    uint32_t sum = rand();
-    sum += rand();
-    sum += rand();
-    sum += rand();
-
-    sum += rand();
-    sum += rand();
-    sum += rand();
-    sum += rand();
-
-    sum += rand();
-    sum += rand();
-    sum += rand();
-    sum += rand();
-
-    // create float in range: 0 <= x <= 12.0
-    float value = (float)sum / RAND_MAX;
-
-    // note: at this point variance will automatically be 1.0 since
-    // variance of uniform number in [0, 1] is (1 / 12) so variance of
-    // sum of 12 uniform numbers in [0, 1] is 1.0
-
-    return (value - 6.0f); // subtract mean to get zero mean output
+    static const int NUM_LAYERS = 128;
+    uint32_t kn[NUM_LAYERS]; // acceptance thresholds of |hz|
+    float    wn[NUM_LAYERS]; // scale from hz to x
+    float    fn[NUM_LAYERS]; // density at layer edges
+
+    Ziggurat(void)
+    {
+        const double m1 = 2147483648.0; // 2^31
+        const double vn = 9.91256303526217e-3; // area of each layer
+        double dn = ZIGGURAT_R;
+        double tn = dn;
+        const double q = vn / exp(-0.5 * dn * dn);
+
+        kn[0] = (uint32_t)((dn / q) * m1);
+        kn[1] = 0;
+        wn[0] = (float)(q  / m1);
+        wn[NUM_LAYERS - 1] = (float)(dn / m1);
+        fn[0] = 1.0f;
+        fn[NUM_LAYERS - 1] = (float)exp(-0.5 * dn * dn);
+        for (int ii = NUM_LAYERS - 2; ii >= 1; --ii)
+        {
+            dn = sqrt(-2.0 * log(vn / dn + exp(-0.5 * dn * dn)));
+            kn[ii + 1] = (uint32_t)((dn / tn) * m1);
+            tn = dn;
+            fn[ii] = (float)exp(-0.5 * dn * dn);
+            wn[ii] = (float)(dn / m1);
+        }
+    }
+
+    static constexpr double ZIGGURAT_R = 3.442619855899; // start of tail
+};
+
+static const Ziggurat& ZigguratTables(void)
+{
+    static const Ziggurat zig; // thread-safe initialization
+    return zig;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Uniform float in (0, 1), safe for log()
+static inline float UniformOpen(Rng& rng)
+{
+    return ((float)(rng.Next32() >> 8) + 0.5f) * (1.0f / (1 << 24));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Ziggurat sample from 64 random bits: the top 32 bits are the signed value and
+// the bottom 7 bits the layer, so layer and value are independent.
+// Returns false if the sample is outside the rectangle of its layer and must
+// be finished by ZigguratSlow().
+static inline bool ZigguratFast(const Ziggurat& zig, uint64_t bits, float* pX)
+{
+    const int32_t  hz = (int32_t)(bits >> 32);
+    const uint32_t iz = (uint32_t)bits & (Ziggurat::NUM_LAYERS - 1);
+    const uint32_t absHz = (hz < 0) ? (0u - (uint32_t)hz) : (uint32_t)hz;
+    *pX = (float)hz * zig.wn[iz];
+    return absHz < zig.kn[iz];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Finish a sample rejected by ZigguratFast(): sample the tail of layer 0 or
+// the wedge of other layers, else start over with new random bits
+static float ZigguratSlow(const Ziggurat& zig, uint64_t bits, Rng& rng)
+{
+    const float r = (float)Ziggurat::ZIGGURAT_R;
+    for (;;)
+    {
+        float x;
+        if (ZigguratFast(zig, bits, &x)) { return x; }
+
+        const int32_t  hz = (int32_t)(bits >> 32);
+        const uint32_t iz = (uint32_t)bits & (Ziggurat::NUM_LAYERS - 1);
+        if (iz == 0) // tail beyond r (no clipping of large deviations)
+        {
+            float y;
+            do
+            {
+                x = -logf(UniformOpen(rng)) / r;
+                y = -logf(UniformOpen(rng));
+            } while (y + y < x * x);
+            return (hz > 0) ? (r + x) : (-r - x);
+        }
+
+        // wedge between the rectangles of layer iz - 1 and iz
+        if (zig.fn[iz] + UniformOpen(rng) * (zig.fn[iz - 1] - zig.fn[iz]) < expf(-0.5f * x * x))
+        {
+            return x;
+        }
+        bits = rng.Next64();
+    }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 // Return integer drawn from poisson distribution with parameter "lam".
 // Uses inversion by sequential search from:
 // https://en.wikipedia.org/wiki/Poisson_distribution#Related_distributions
-uint32_t randp(float lam)
+// O(lam) so only used for lam < PTRS_MIN_LAMBDA
+static uint32_t PoissonKnuth(float lam, Rng& rng)
 {
     // Note: need uniform number in [0, 1) (if u = 1.0 then infinite loop below)
-    const float u = (float)rand() / (RAND_MAX + 1); // random float in [0, 1)
+    const float u = rng.Uniform(); // random float in [0, 1)
 
     // Knuth algorithm
     // Probability of k events: Pr{k  } = lam^k * exp(-lam) / k!
@@ -57,14 +123,148 @@ uint32_t randp(float lam)
     {
         ++x;                 // move to next candidate output value
         p *= lam / x;        // update Pr{k=x}
+        if (s + p == s) { break; } // sum stuck below u due to float rounding
         s += p;              // update sum of probabilities
     }
     return x;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Transformed rejection with squeeze (PTRS) from:
+// Hormann, "The transformed rejection method for generating Poisson random
+// variables", Insurance: Mathematics and Economics, 1993.
+// O(1) per sample, exact for lam >= PTRS_MIN_LAMBDA. Set up is a sqrt and a
+// divide, logs are only needed by samples outside the squeeze (about 1 in 4).
+static const float PTRS_MIN_LAMBDA = 10.0f;
+
+struct Ptrs
+{
+    float lam;
+    float a;
+    float b;
+    float vr; // squeeze: accept without evaluating the density
+
+    explicit Ptrs(float lambda)
+    {
+        lam = lambda;
+        b   = 0.931f + 2.53f * sqrtf(lambda);
+        a   = -0.059f + 0.02483f * b;
+        vr  = 0.9277f - 3.6224f / (b - 2.0f);
+    }
+
+    // log(lam^k * exp(-lam) / k!). For large k, Stirling's series for log(k!)
+    // leaves terms that are all small, so float is accurate (rather than the
+    // difference of nearly equal large terms k * log(lam) and lgamma(k + 1))
+    inline float LogPoisson(float k) const
+    {
+        if (k < 10.0f) { return -lam + k * logf(lam) - lgammaf(k + 1.0f); }
+        const float d = k - lam;
+        const float invK = 1.0f / k;
+        return d - k * log1pf(d / lam) - 0.5f * logf(6.2831853f * k) -
+               invK * (1.0f / 12.0f - invK * invK * (1.0f / 360.0f));
+    }
+
+    inline uint32_t Sample(Rng& rng) const
+    {
+        for (;;)
+        {
+            // two 24-bit uniforms from one random value
+            const uint64_t bits = rng.Next64();
+            const float U  = (float)(bits >> 40) * (1.0f / (1 << 24)) - 0.5f;
+            const float V  = (float)((bits >> 8) & 0xFFFFFFu) * (1.0f / (1 << 24));
+            const float us = 0.5f - fabsf(U);
+            const float k  = floorf((2.0f * a / us + b) * U + lam + 0.43f);
+
+            if ((us >= 0.07f) && (V <= vr)) { return (uint32_t)k; } // squeeze (most samples)
+
+            if ((k < 0.0f) || ((us < 0.013f) && (V > us))) { continue; }
+
+            // compare with log of Poisson probability of k
+            const float invAlpha = 1.1239f + 1.1328f / (b - 3.4f);
+            if ((V > 0.0f) && (logf(V * invAlpha / (a / (us * us) + b)) <= LogPoisson(k)))
+            {
+                return (uint32_t)k;
+            }
+        }
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+uint32_t randp(float lam, Rng& rng)
+{
+    return (lam < PTRS_MIN_LAMBDA) ? PoissonKnuth(lam, rng) : Ptrs(lam).Sample(rng);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void PoissonFill(float lam, uint32_t count, uint32_t* pOut, Rng& rng)
+{
+    if (lam < PTRS_MIN_LAMBDA)
+    {
+        while (count--) { *pOut++ = PoissonKnuth(lam, rng); }
+        return;
+    }
+    const Ptrs ptrs(lam);
+    while (count--) { *pOut++ = ptrs.Sample(rng); }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void PoissonFill(const uint32_t* pLam, uint32_t count, uint32_t* pOut, Rng& rng)
+{
+    while (count--)
+    {
+        const uint32_t lam = *pLam++;
+        *pOut++ = (lam < PTRS_MIN_LAMBDA) ? PoissonKnuth((float)lam, rng) : Ptrs((float)lam).Sample(rng);
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Gaussian random number generator, zero mean and unit variance
-// Note: randn() is a wrapper so we can later replace IrwinHallDist() with
-// more accurate Gaussian random number generator.
-float randn(void) { return IrwinHallDist(); }
+float randn(Rng& rng)
+{
+    const Ziggurat& zig = ZigguratTables();
+    const uint64_t bits = rng.Next64();
+    float x;
+    return ZigguratFast(zig, bits, &x) ? x : ZigguratSlow(zig, bits, rng);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void RandnFill(float* pOut, uint32_t count, Rng& rng)
+{
+    const Ziggurat& zig = ZigguratTables();
 
+    // Fast path for a chunk of samples from consecutive counters, with no
+    // dependency between samples (so it pipelines), then finish the ~1% of
+    // rejected samples from random values after the chunk
+    const uint32_t CHUNK = 256;
+    uint8_t rejected[CHUNK];
+    while (count)
+    {
+        const uint32_t num     = (count < CHUNK) ? count : CHUNK;
+        const uint64_t counter = rng.Tell();
+        uint32_t numRejected = 0;
+        for (uint32_t ii = 0; ii < num; ++ii)
+        {
+            rejected[ii] = !ZigguratFast(zig, rng.At(counter + ii), pOut + ii);
+            numRejected += rejected[ii];
+        }
+        rng.Seek(counter + num);
+
+        for (uint32_t ii = 0; numRejected; ++ii)
+        {
+            if (rejected[ii])
+            {
+                pOut[ii] = ZigguratSlow(zig, rng.At(counter + ii), rng);
+                --numRejected;
+            }
+        }
+        pOut  += num;
+        count -= num;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+Rng& ThreadRng(void)
+{
+    thread_local Rng rng;
+    return rng;
+}
@@ -1,9 +1,11 @@
 // Unit tests for polygon.cpp functions
 
-// Next two lines enable memory leak detection as per:
+// Next two lines enable memory leak detection (MSVC only) as per:
 // https://learn.microsoft.com/en-us/visualstudio/debugger/finding-memory-leaks-using-the-crt-library?view=vs-2022
+#if defined(_MSC_VER)
 #define _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>      // _Crt* memory leak detection functions
+#endif
 
 #include <time.h>        // time()
 #include <vector>
@@ -21,9 +23,14 @@
 
 #include "random.h"
 #include "RenderFXP.h"
+#include "CanvasT.h"
+#include "WorkerPool.h"
+#include "DepthBuffer.h"
+#include "SpadSim.h"
 
 using namespace std;
 
+#if defined(_MSC_VER)
 ////////////////////////////////////////////////////////////////////////////////
 // Memory leak detection class cut/pasted from:
 // https://stackoverflow.com/questions/29174938/googletest-and-memory-leaks
@@ -51,6 +58,61 @@ private:
     }
     _CrtMemState m_startState;
 };
+#else
+class MemoryLeakDetector { // no CRT debug heap, no leak detection
+public:
+    MemoryLeakDetector() {}  // user-provided so instances aren't unused variables
+};
+#endif // #if defined(_MSC_VER)
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(PolygonTests, FixedMath) {
+    // usable in constant expressions
+    typedef Fixed<FIXED_FBITS> Q16;
+    constexpr Q16 half = Q16::FromDouble(0.5);
+    static_assert((half * 3).ToInt() == 2, "constexpr Fixed");
+    static_assert(FixedMul(INT_TO_FIXED(3), FIXED_HALF) == INT_TO_FIXED(3) / 2, "constexpr FixedMul()");
+    static_assert(FixedDiv(5, 0) == INT_TO_FIXED(5), "FixedDiv() by 0 divides by 1");
+
+    // rounding of +-1.5 * 0.5 = +-0.75, which is 1.5 LSB of Q1 (raw values
+    // are halves)
+    EXPECT_EQ((FixedMulT<1, FIXED_ROUND_TRUNC  >(-3, 1)), -1);
+    EXPECT_EQ((FixedMulT<1, FIXED_ROUND_NEAREST>(-3, 1)), -2);
+    EXPECT_EQ((FixedMulT<1, FIXED_ROUND_FLOOR  >(-3, 1)), -2);
+    EXPECT_EQ((FixedMulT<1, FIXED_ROUND_TRUNC  >( 3, 1)),  1);
+    EXPECT_EQ((FixedMulT<1, FIXED_ROUND_NEAREST>( 3, 1)),  2);
+    EXPECT_EQ((FixedMulT<1, FIXED_ROUND_FLOOR  >( 3, 1)),  1);
+
+    // default rounding truncates toward zero like integer division, others
+    // are within 1 LSB and round to nearest is within 1/2 LSB
+    Rng rng(8);
+    for (int i = 0; i < 100000; ++i)
+    {
+        const Fixedpoint a = (int32_t)rng.Next32() / 32;    // up to +-1024.0
+        const Fixedpoint b = (int32_t)rng.Next32() / 131072; // up to +-0.25
+        if (a == 0) { continue; }
+        const int64_t prod = (int64_t)a * b;
+        EXPECT_EQ(FixedMul(a, b), (Fixedpoint)(prod / FIXED_ONE));
+        EXPECT_EQ(FixedDiv(b, a), (Fixedpoint)((int64_t)b * FIXED_ONE / a));
+
+        const double ideal = prod / (double)FIXED_ONE;
+        EXPECT_LE(abs(ideal - (FixedMulT<FIXED_FBITS, FIXED_ROUND_NEAREST>(a, b))), 0.5);
+        const Fixedpoint floorProd = FixedMulT<FIXED_FBITS, FIXED_ROUND_FLOOR>(a, b);
+        EXPECT_LE(floorProd, ideal);
+        EXPECT_GT(floorProd + 1, ideal);
+    }
+
+    // value type matches the raw functions
+    Q16 x = Q16::FromInt(-7) / Q16::FromInt(3);
+    EXPECT_EQ(x.raw, FixedDiv(Q16::FromInt(-7).raw, INT_TO_FIXED(3)));
+    x *= Q16::FromDouble(1.25);
+    EXPECT_EQ(x.raw, FixedMul(FixedDiv(Q16::FromInt(-7).raw, INT_TO_FIXED(3)), DOUBLE_TO_FIXED(1.25)));
+    EXPECT_EQ(x.ToInt(), -3); // -2.917
+    EXPECT_EQ(Q16::FromDouble(-1.5).ToInt(), -1); // halves up
+    EXPECT_EQ(Q16::FromDouble( 1.5).ToInt(),  2);
+    EXPECT_NEAR(x.ToDouble(), -7.0 / 3.0 * 1.25, 2.0 / FIXED_ONE);
+    EXPECT_TRUE(x < Q16());
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 TEST(PolygonTests, CosSin) {
@@ -148,6 +210,112 @@ TEST(PolygonTests, Random) {
     free(pSamples);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Counter-based generator is seekable and streams are independent
+TEST(PolygonTests, Rng) {
+    const uint32_t count = 100000u;
+    std::vector<uint32_t> bulk(count);
+    std::vector<float>    uniform(count);
+
+    // bulk generation and seeking give the same values as Next32()
+    Rng rng(7, 3);
+    rng.Fill(bulk.data(), count);
+    EXPECT_EQ(rng.Tell(), count);
+    rng.Seek(0);
+    for (uint32_t i = 0; i < count; i += 997) { rng.Seek(i); EXPECT_EQ(rng.Next32(), bulk[i]); }
+    EXPECT_EQ(rng.At(count - 1) >> 32, bulk[count - 1]);
+
+    // other streams and seeds differ
+    Rng other(7, 4);
+    Rng otherSeed(8, 3);
+    int numSame = 0;
+    for (uint32_t i = 0; i < 1000; ++i)
+    {
+        numSame += (other.Next32() == bulk[i]) + (otherSeed.Next32() == bulk[i]);
+    }
+    EXPECT_EQ(numSame, 0);
+
+    // uniform in [0, 1) has mean 1/2 and variance 1/12
+    rng.FillUniform(uniform.data(), count);
+    double mean, var;
+    MeanVariance<float>(count, uniform.data(), &mean, &var);
+    EXPECT_NEAR(mean, 0.5,        1e-2);
+    EXPECT_NEAR(var,  1.0 / 12.0, 1e-2);
+    for (uint32_t i = 0; i < count; ++i) { ASSERT_TRUE((0.0f <= uniform[i]) && (uniform[i] < 1.0f)); }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Poisson samplers match the Poisson distribution for small and large lambda
+TEST(PolygonTests, PoissonFill) {
+    const uint32_t count = 400000u;
+    std::vector<uint32_t> samples(count);
+    std::vector<uint32_t> lams(count);
+    Rng rng(5);
+
+    const float lams4[4] = { 3.0f, 30.0f, 700.0f, 5000.0f };
+    for (int ii = 0; ii < 4; ++ii)
+    {
+        const float lam = lams4[ii];
+        if (ii & 1) { PoissonFill(lam, count, samples.data(), rng); } // same lambda
+        else
+        {
+            std::fill(lams.begin(), lams.end(), (uint32_t)lam);        // lambda per sample
+            PoissonFill(lams.data(), count, samples.data(), rng);
+        }
+
+        double mean, var;
+        MeanVariance<uint32_t>(count, samples.data(), &mean, &var);
+        EXPECT_NEAR(mean, lam, 0.01 * sqrt(lam));
+        EXPECT_NEAR(var,  lam, 0.02 * lam);
+
+        // Kolmogorov-Smirnov distance from the cumulative distribution
+        // (1% significance level is 1.63 / sqrt(count))
+        std::vector<uint32_t> hist(2 * (size_t)lam + 50);
+        for (uint32_t i = 0; i < count; ++i) { if (samples[i] < hist.size()) { hist[samples[i]]++; } }
+        double cdf = 0.0;
+        double empiricalCdf = 0.0;
+        double distance = 0.0;
+        for (size_t k = 0; k < hist.size(); ++k)
+        {
+            cdf          += exp(-lam + k * log((double)lam) - lgamma(k + 1.0));
+            empiricalCdf += hist[k] / (double)count;
+            distance = std::max(distance, fabs(empiricalCdf - cdf));
+        }
+        EXPECT_LT(distance, 1.63 / sqrt((double)count)) << "lambda " << lam;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Bulk Gaussian generator has unit normal moments and tails
+TEST(PolygonTests, RandnFill) {
+    const uint32_t count = 1000000u;
+    std::vector<float> samples(count);
+    std::vector<float> again(count);
+
+    Rng rng(11);
+    RandnFill(samples.data(), count, rng);
+    double mean, var;
+    MeanVariance<float>(count, samples.data(), &mean, &var);
+    EXPECT_NEAR(mean, 0.0, 5e-3);
+    EXPECT_NEAR(var,  1.0, 5e-3);
+
+    // Pr{|x| > 3} = 0.0027 and Pr{|x| > 4} = 6.3e-5 (not clipped)
+    uint32_t num3 = 0;
+    uint32_t num4 = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        num3 += fabsf(samples[i]) > 3.0f;
+        num4 += fabsf(samples[i]) > 4.0f;
+    }
+    EXPECT_NEAR(num3 / (double)count, 2.7e-3, 3e-4);
+    EXPECT_NEAR(num4 / (double)count, 6.3e-5, 3e-5);
+
+    // repeatable for the same stream position
+    rng.Seek(0);
+    RandnFill(again.data(), count, rng);
+    EXPECT_EQ(memcmp(samples.data(), again.data(), count * sizeof(float)), 0);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Determine radius in a raster scan without sqrt() in inner loop
 TEST(PolygonTests, RadiusRaster) {
@@ -214,6 +382,866 @@ TEST(PolygonTests, RadiusRaster) {
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Fill a rectangle that is partially off screen and check the covered pixels
+TEST(PolygonTests, FillSpan) {
+    const int width  = 64;
+    const int height = 48;
+    Canvas32 canvas(width, height);
+    canvas.SetCanvas(0u);
+
+    // Note: right and bottom edges are not drawn
+    Point rect[] = {{-10, 5}, {20, 5}, {20, 15}, {-10, 15}};
+    RasterContext context(&canvas);
+    FillConvexPolygon(rect, 4, 7, 0, 0, &context);
+
+    const uint32_t* pFB = (const uint32_t*)canvas.GetFrameBuffer();
+    for (int Y = 0; Y < height; ++Y)
+    {
+        for (int X = 0; X < width; ++X)
+        {
+            uint32_t expected = ((5 <= Y) && (Y < 15) && (X < 20)) ? 7u : 0u;
+            EXPECT_EQ(pFB[Y * width + X], expected);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Accumulate sub-exposures of the same polygon and check for saturation
+TEST(PolygonTests, AddSpan) {
+    const int width  = 32;
+    const int height = 16;
+    Canvas32 canvas(width, height);
+    canvas.SetCanvas(0u);
+
+    Point tri[] = {{0, 0}, {width, 0}, {0, height}};
+    RasterContext context(&canvas);
+    context.Rop = RASTER_ADD;
+    const int numSubExposures = 5;
+    for (int i = 0; i < numSubExposures; ++i)
+    {
+        FillConvexPolygon(tri, 3, 30, 0, 0, &context);
+    }
+
+    const uint32_t* pFB = (const uint32_t*)canvas.GetFrameBuffer();
+    EXPECT_EQ(pFB[0],             30u * numSubExposures); // inside triangle
+    EXPECT_EQ(pFB[width * height - 1], 0u);               // outside triangle
+
+    // photons saturate rather than wrap
+    FillConvexPolygon(tri, 3, 0xFFFFFFF0, 0, 0, &context);
+    EXPECT_EQ(pFB[0], 0xFFFFFFFFu);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 8 and 16-bit canvases draw the same pixels as Canvas32 and saturate at
+// their largest pixel value
+TEST(PolygonTests, NarrowCanvas) {
+    const int width  = 32;
+    const int height = 16;
+    Canvas8  canvas8(width, height);
+    Canvas16 canvas16(width, height);
+    Canvas32 canvas32(width, height);
+    Canvas*  canvases[3] = { &canvas8, &canvas16, &canvas32 };
+
+    Point tri[] = {{0, 0}, {width, 0}, {0, height}};
+    const uint32_t photons[3] = { 30, 100, 0xFFF0 };
+    for (int c = 0; c < 3; ++c)
+    {
+        canvases[c]->SetCanvas(0x01010101u);
+        RasterContext context(canvases[c]);
+        context.Rop = RASTER_ADD;
+        for (int i = 0; i < 3; ++i) { FillConvexPolygon(tri, 3, photons[i], 0, 0, &context); }
+    }
+
+    const uint8_t*  p8  = (const uint8_t*) canvas8.GetFrameBuffer();
+    const uint16_t* p16 = (const uint16_t*)canvas16.GetFrameBuffer();
+    const uint32_t* p32 = (const uint32_t*)canvas32.GetFrameBuffer();
+    for (int i = 0; i < width * height; ++i)
+    {
+        if (p32[i] == 0x01010101u) // outside triangle
+        {
+            EXPECT_EQ(p8[i],  0x01u);
+            EXPECT_EQ(p16[i], 0x0101u);
+        }
+        else
+        {
+            EXPECT_EQ(p8[i],  0xFFu);   // 1 + 30 + 100 + 0xFFF0 saturates
+            EXPECT_EQ(p16[i], 0xFFFFu);
+            EXPECT_EQ(p32[i], 0x01010101u + 30 + 100 + 0xFFF0);
+        }
+    }
+
+    // unsaturated sums match Canvas32
+    canvas8.SetCanvas(0u);
+    canvas32.SetCanvas(0u);
+    RasterContext context8(&canvas8);
+    RasterContext context32(&canvas32);
+    context8.Rop  = RASTER_ADD;
+    context32.Rop = RASTER_ADD;
+    FillConvexPolygon(tri, 3, 200, 0, 0, &context8);
+    FillConvexPolygon(tri, 3, 200, 0, 0, &context32);
+    for (int i = 0; i < width * height; ++i) { EXPECT_EQ(p8[i], p32[i]); }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Drawing random polygons band by band with a Y clip range must give the
+// same image as drawing them without clipping
+TEST(PolygonTests, ClipBands) {
+    const int width  = 160;
+    const int height = 120;
+    Canvas32 fullCanvas(width, height);
+    Canvas32 bandCanvas(width, height);
+    fullCanvas.SetCanvas(0u);
+    bandCanvas.SetCanvas(0u);
+    const uint32_t* pFull = (const uint32_t*)fullCanvas.GetFrameBuffer();
+    const uint32_t* pBand = (const uint32_t*)bandCanvas.GetFrameBuffer();
+    RasterContext fullContext(&fullCanvas);
+    RasterContext bandContext(&bandCanvas);
+    fullContext.Rop = RASTER_ADD;
+    bandContext.Rop = RASTER_ADD;
+
+    srand(1);
+    for (int n = 0; n < 200; ++n)
+    {
+        // random triangle with clockwise winding that may extend off canvas
+        Point tri[3];
+        for (int v = 0; v < 3; ++v)
+        {
+            tri[v].X = rand() % (3 * width)  - width;
+            tri[v].Y = rand() % (3 * height) - height;
+        }
+        long cross = (long)(tri[1].X - tri[0].X) * (tri[2].Y - tri[0].Y) -
+                     (long)(tri[1].Y - tri[0].Y) * (tri[2].X - tri[0].X);
+        if (cross < 0) { Point tmp = tri[1]; tri[1] = tri[2]; tri[2] = tmp; }
+
+        FillConvexPolygon(tri, 3, 1, 0, 0, &fullContext);
+
+        int bandHeight = 1 + rand() % 17;
+        for (int YMin = 0; YMin < height; YMin += bandHeight)
+        {
+            bandContext.YClipMin = YMin;
+            bandContext.YClipMax = YMin + bandHeight - 1;
+            FillConvexPolygon(tri, 3, 1, 0, 0, &bandContext);
+        }
+    }
+
+    EXPECT_EQ(memcmp(pFull, pBand, width * height * sizeof(uint32_t)), 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Rolling shutter rendering of a static scene matches a global shutter render
+TEST(PolygonTests, RollingShutterStatic) {
+    const int width  = 96;
+    const int height = 64;
+
+    // a square facing the viewpoint
+    Point3 verts[4] = {
+        {-INT_TO_FIXED(10),  INT_TO_FIXED(10), 0},
+        { INT_TO_FIXED(10),  INT_TO_FIXED(10), 0},
+        { INT_TO_FIXED(10), -INT_TO_FIXED(10), 0},
+        {-INT_TO_FIXED(10), -INT_TO_FIXED(10), 0} };
+    int32_t vertNums[4] = {0, 1, 2, 3};
+    Face    face = {vertNums, 4, 9};
+    Point3  xformed[4], projected[4];
+    Point   screen[4];
+
+    PObject square;
+    memset(&square, 0, sizeof(square));
+    square.RecalcFunc = XformAndProjectPObject;
+    square.DrawFunc   = DrawPObject;
+    square.RecalcXform = 1;
+    square.NumVerts = 4;
+    square.VertexList = verts;
+    square.XformedVertexList = xformed;
+    square.ProjectedVertexList = projected;
+    square.ScreenVertexList = screen;
+    square.NumFaces = 1;
+    square.FaceList = &face;
+    square.XformToWorld[0][0] = INT_TO_FIXED(1);
+    square.XformToWorld[1][1] = INT_TO_FIXED(1);
+    square.XformToWorld[2][2] = INT_TO_FIXED(1);
+    square.XformToWorld[1][3] = INT_TO_FIXED(20);  // above center
+    square.XformToWorld[2][3] = -INT_TO_FIXED(150);
+    PObject* objectList[1] = {&square};
+
+    const Fixedpoint nearClipZ = DOUBLE_TO_FIXED(-2.0);
+    Canvas32 globalCanvas(width, height);
+    globalCanvas.SetCanvas(0u);
+    RasterContext globalContext(&globalCanvas);
+    XformAndProjectPObject(&square, &globalCanvas, nearClipZ);
+    DrawPObject(&square, &globalContext);
+
+    const int numSubExposures = 3;
+    RollingShutter shutter = {2, 9000, 30, numSubExposures, 11111};
+    Canvas32 rollingCanvas(width, height);
+    rollingCanvas.SetCanvas(0xFFu); // must be cleared by each line group
+    RasterContext rollingContext(&rollingCanvas);
+    RenderRollingShutter(objectList, 1, &rollingContext, nearClipZ, &shutter);
+    EXPECT_EQ(rollingContext.Rop, RASTER_SET); // raster settings restored
+    EXPECT_EQ(rollingContext.YClipMax, height - 1);
+
+    const uint32_t* pGlobal  = (const uint32_t*)globalCanvas.GetFrameBuffer();
+    const uint32_t* pRolling = (const uint32_t*)rollingCanvas.GetFrameBuffer();
+    int numLit = 0;
+    for (int i = 0; i < width * height; ++i)
+    {
+        EXPECT_EQ(pRolling[i], pGlobal[i] * numSubExposures);
+        numLit += (pGlobal[i] != 0);
+    }
+    EXPECT_GT(numLit, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Band-parallel rendering with a persistent worker pool over several frames
+// matches a single threaded render
+TEST(PolygonTests, WorkerPoolBands) {
+    const int width  = 200;
+    const int height = 150;
+    Canvas32 serialCanvas(width, height);
+    Canvas32 bandCanvas(width, height);
+    const uint32_t* pSerial = (const uint32_t*)serialCanvas.GetFrameBuffer();
+    const uint32_t* pBand   = (const uint32_t*)bandCanvas.GetFrameBuffer();
+
+    WorkerPool pool(4);
+    EXPECT_EQ(pool.NumWorkers(), 4);
+    RasterContext serialContext(&serialCanvas);
+    std::vector<RasterContext> bandContexts(pool.NumWorkers(), RasterContext(&bandCanvas));
+
+    srand(2);
+    for (int frame = 0; frame < 10; ++frame)
+    {
+        // random clockwise quads, drawn in order so overlaps must match
+        Point quads[20][4];
+        for (int n = 0; n < 20; ++n)
+        {
+            int X = rand() % width  - 20;
+            int Y = rand() % height - 20;
+            int W = 1 + rand() % 80;
+            int H = 1 + rand() % 80;
+            Point quad[4] = {{X, Y}, {X + W, Y}, {X + W, Y + H}, {X, Y + H}};
+            memcpy(quads[n], quad, sizeof(quad));
+        }
+
+        serialCanvas.SetCanvas(0u);
+        for (int n = 0; n < 20; ++n) { FillConvexPolygon(quads[n], 4, n + 1, 0, 0, &serialContext); }
+
+        bandCanvas.SetCanvas(0u);
+        pool.Run([&](int32_t band)
+        {
+            RasterContext& context = bandContexts[band];
+            context.YClipMin = band       * height / pool.NumWorkers();
+            context.YClipMax = (band + 1) * height / pool.NumWorkers() - 1;
+            for (int n = 0; n < 20; ++n)
+            {
+                FillConvexPolygon(quads[n], 4, n + 1, 0, 0, &context);
+            }
+        });
+
+        EXPECT_EQ(memcmp(pSerial, pBand, width * height * sizeof(uint32_t)), 0);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Depth tested polygons drawn in any order match a back-to-front (painter's)
+// render, and depth is interpolated across sloped polygons
+TEST(PolygonTests, DepthBuffer) {
+    const int width  = 150; // not a multiple of DEPTH_TILE_WIDTH
+    const int height = 100;
+    Canvas32 depthCanvas(width, height);
+    Canvas32 painterCanvas(width, height);
+    const uint32_t* pDepthFB   = (const uint32_t*)depthCanvas.GetFrameBuffer();
+    const uint32_t* pPainterFB = (const uint32_t*)painterCanvas.GetFrameBuffer();
+    DepthBuffer depthBuffer(width, height, INT_TO_FIXED(100));
+    RasterContext depthContext(&depthCanvas);
+    RasterContext painterContext(&painterCanvas);
+    depthContext.pDepth = &depthBuffer;
+
+    // random clockwise quads at distinct distances facing the viewpoint
+    const int numQuads = 40;
+    Point   quads[numQuads][4];
+    int32_t depths[numQuads];
+    srand(3);
+    for (int n = 0; n < numQuads; ++n)
+    {
+        int X = rand() % width  - 20;
+        int Y = rand() % height - 20;
+        int W = 1 + rand() % 100;
+        int H = 1 + rand() % 60;
+        Point quad[4] = {{X, Y}, {X + W, Y}, {X + W, Y + H}, {X, Y + H}};
+        memcpy(quads[n], quad, sizeof(quad));
+        depths[n] = depthBuffer.ViewZToDepth(-INT_TO_FIXED(200 + 10 * n));
+    }
+
+    // painter's algorithm: farthest (last) quad first
+    painterCanvas.SetCanvas(0u);
+    for (int n = numQuads; n-- > 0; )
+    {
+        FillConvexPolygon(quads[n], 4, n + 1, 0, 0, &painterContext);
+    }
+
+    // depth buffer: drawn in a shuffled order, twice to test equal depths
+    int order[numQuads];
+    for (int n = 0; n < numQuads; ++n) { order[n] = n; }
+    for (int n = numQuads - 1; n > 0; --n)
+    {
+        int k = rand() % (n + 1);
+        int tmp = order[n]; order[n] = order[k]; order[k] = tmp;
+    }
+    depthCanvas.SetCanvas(0u);
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (int n = 0; n < numQuads; ++n)
+        {
+            const int q = order[n];
+            const int32_t quadDepths[4] = {depths[q], depths[q], depths[q], depths[q]};
+            FillConvexPolygon(quads[q], 4, q + 1, 0, 0, &depthContext, quadDepths);
+        }
+    }
+    EXPECT_EQ(memcmp(pDepthFB, pPainterFB, width * height * sizeof(uint32_t)), 0);
+
+    // A quad sloping from near on the left to far on the right passes
+    // through a flat quad at the middle of the canvas, in either draw order
+    Point full[4] = {{0, 0}, {width, 0}, {width, height}, {0, height}};
+    const int32_t flatDepth = depthBuffer.ViewZToDepth(-INT_TO_FIXED(400));
+    const int32_t flat[4]   = {flatDepth, flatDepth, flatDepth, flatDepth};
+    const int32_t slope[4]  = {2 * flatDepth, 0, 0, 2 * flatDepth};
+    for (int flatFirst = 0; flatFirst < 2; ++flatFirst)
+    {
+        depthBuffer.Clear();
+        depthCanvas.SetCanvas(0u);
+        if (flatFirst) { FillConvexPolygon(full, 4, 1, 0, 0, &depthContext, flat);  }
+        FillConvexPolygon(full, 4, 2, 0, 0, &depthContext, slope);
+        if (!flatFirst) { FillConvexPolygon(full, 4, 1, 0, 0, &depthContext, flat); }
+
+        for (int Y = 0; Y < height; ++Y)
+        {
+            for (int X = 0; X < width; ++X)
+            {
+                if (abs(X - width / 2) <= 1) { continue; } // intersection
+                uint32_t expected = (X < width / 2) ? 2u : 1u;
+                EXPECT_EQ(pDepthFB[Y * width + X], expected);
+            }
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Objects sort back to front by view space centroid, keeping the order of
+// objects at equal depth
+TEST(PolygonTests, SortObjects) {
+    const int numObjects = 8;
+    const int startZ[numObjects] = {-100, -500, -300, -300, -50, -700, -300, -200};
+    PObject objects[numObjects];
+    PObject* objectList[numObjects];
+    memset(objects, 0, sizeof(objects));
+    for (int i = 0; i < numObjects; ++i)
+    {
+        objects[i].CenterInView.Z = Fixed<FIXED_FBITS>::FromInt(startZ[i]).raw;
+        objectList[i] = &objects[i];
+    }
+
+    SortObjects(objectList, numObjects);
+    const int expected[numObjects] = {5, 1, 2, 3, 6, 7, 0, 4};
+    for (int i = 0; i < numObjects; ++i) { EXPECT_EQ(objectList[i], &objects[expected[i]]); }
+
+    // objects drift between frames, resort from previous order
+    objects[4].CenterInView.Z = -INT_TO_FIXED(600);
+    objects[5].CenterInView.Z = -INT_TO_FIXED(400);
+    SortObjects(objectList, numObjects);
+    const int resorted[numObjects] = {4, 1, 5, 2, 3, 6, 7, 0};
+    for (int i = 0; i < numObjects; ++i) { EXPECT_EQ(objectList[i], &objects[resorted[i]]); }
+
+    // centroid is set when projecting
+    Point3 verts[2] = {{-INT_TO_FIXED(10), INT_TO_FIXED(4), INT_TO_FIXED(1)},
+                       { INT_TO_FIXED(30), INT_TO_FIXED(8), INT_TO_FIXED(3)}};
+    Point3 xformed[2], projected[2];
+    Point  screen[2];
+    PObject& object = objects[0];
+    object.NumVerts = 2;
+    object.VertexList = verts;
+    object.XformedVertexList = xformed;
+    object.ProjectedVertexList = projected;
+    object.ScreenVertexList = screen;
+    memset(object.XformToWorld, 0, sizeof(Xform));
+    object.XformToWorld[0][0] = INT_TO_FIXED(1);
+    object.XformToWorld[1][1] = INT_TO_FIXED(1);
+    object.XformToWorld[2][2] = INT_TO_FIXED(1);
+    object.XformToWorld[2][3] = -INT_TO_FIXED(150);
+    Canvas32 canvas(64, 48);
+    XformAndProjectPObject(&object, &canvas, DOUBLE_TO_FIXED(-2.0));
+    EXPECT_EQ(object.CenterInView.X, INT_TO_FIXED(10));
+    EXPECT_EQ(object.CenterInView.Y, INT_TO_FIXED(6));
+    EXPECT_EQ(object.CenterInView.Z, -INT_TO_FIXED(148));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SIMD kernels of SpadSim (when compiled in) give the same output as the
+// scalar kernel for every combination of stages
+TEST(SpadSimTests, SimdMatchesScalar) {
+    const int width  = 100; // not a multiple of SIMD width
+    const int height =  60;
+    SpadSim spadSim(width, height);
+    std::vector<uint32_t> frame(width * height);
+    std::vector<uint32_t> simdOut(width * height);
+    std::vector<uint32_t> scalarOut(width * height);
+
+    // mostly noise from LUT, some Poisson samples generated on-the-fly
+    srand(4);
+    for (size_t i = 0; i < frame.size(); ++i) { frame[i] = rand() % 320; }
+
+    for (int stages = 0; stages < 8; ++stages)
+    {
+        const bool enableLensDist = (stages & 1) != 0;
+        const bool enableDF       = (stages & 2) != 0;
+        const bool enablePWL      = (stages & 4) != 0;
+        spadSim.SetFrame(5);
+        spadSim.AddDistortion(frame.data(), simdOut.data(), enableLensDist, enableDF, enablePWL);
+        spadSim.SetFrame(5);
+        spadSim.AddDistortionScalar(frame.data(), scalarOut.data(), enableLensDist, enableDF, enablePWL);
+        EXPECT_EQ(memcmp(simdOut.data(), scalarOut.data(), frame.size() * sizeof(uint32_t)), 0);
+
+        // same pipeline selected by bitmask
+        const uint32_t mask = (enableLensDist ? SpadSim::STAGE_LENS_DIST : 0u) |
+                              (enableDF       ? SpadSim::STAGE_DF        : 0u) |
+                              (enablePWL      ? SpadSim::STAGE_PWL       : 0u);
+        spadSim.SetFrame(5);
+        spadSim.AddDistortionStages(frame.data(), scalarOut.data(), mask);
+        EXPECT_EQ(memcmp(simdOut.data(), scalarOut.data(), frame.size() * sizeof(uint32_t)), 0);
+
+        // bilinear lens distortion
+        spadSim.SetFrame(6);
+        spadSim.AddDistortionStages(frame.data(), simdOut.data(), mask | SpadSim::STAGE_BILINEAR, true);
+        spadSim.SetFrame(6);
+        spadSim.AddDistortionStages(frame.data(), scalarOut.data(), mask | SpadSim::STAGE_BILINEAR, false);
+        EXPECT_EQ(memcmp(simdOut.data(), scalarOut.data(), frame.size() * sizeof(uint32_t)), 0);
+    }
+}
+
+TEST(SpadSimTests, PixelTypes) {
+    const int width  = 100; // not a multiple of SIMD width
+    const int height =  60;
+    SpadSim spadSim(width, height);
+    Canvas8  frame8(width, height);
+    Canvas16 frame16(width, height);
+    Canvas32 frame32(width, height);
+    uint8_t*  p8  = (uint8_t*) frame8.GetFrameBuffer();
+    uint16_t* p16 = (uint16_t*)frame16.GetFrameBuffer();
+    uint32_t* p32 = (uint32_t*)frame32.GetFrameBuffer();
+    srand(6);
+    for (int i = 0; i < width * height; ++i)
+    {
+        p32[i] = rand() % 256;
+        p16[i] = (uint16_t)p32[i];
+        p8[i]  = (uint8_t)p32[i];
+    }
+    std::vector<uint32_t> refOut(width * height);
+    std::vector<uint32_t> out32(width * height);
+    std::vector<uint8_t>  out8(width * height);
+
+    // any input and output pixel type, SIMD or scalar, gives the same pixels
+    const uint32_t stages[3] = { SpadSim::STAGE_DF,
+        SpadSim::STAGE_LENS_DIST | SpadSim::STAGE_DF | SpadSim::STAGE_PWL,
+        SpadSim::STAGE_LENS_DIST | SpadSim::STAGE_BILINEAR | SpadSim::STAGE_BLUR };
+    for (int ii = 0; ii < 3; ++ii)
+    {
+        spadSim.SetFrame(9);
+        spadSim.AddDistortionStages(p32, refOut.data(), stages[ii]);
+        for (int simd = 0; simd < 2; ++simd)
+        {
+            spadSim.SetFrame(9);
+            spadSim.AddDistortionStages(p16, out32.data(), stages[ii], simd != 0);
+            EXPECT_EQ(memcmp(refOut.data(), out32.data(), refOut.size() * sizeof(uint32_t)), 0);
+            spadSim.SetFrame(9);
+            spadSim.AddDistortionStages(p8, out8.data(), stages[ii], simd != 0);
+            for (int i = 0; i < width * height; ++i) { EXPECT_EQ(out8[i], refOut[i] & 0xFF); }
+        }
+    }
+}
+
+TEST(SpadSimTests, OutputFormats) {
+    const int width  = 100; // multiple of 4 for RAW10, not of SIMD width
+    const int height =  60;
+    SpadSim spadSim(width, height);
+    std::vector<uint16_t> frame(width * height);
+    srand(7);
+    for (size_t i = 0; i < frame.size(); ++i) { frame[i] = (uint16_t)(rand() % 5000); }
+    std::vector<uint16_t> ref(width * height);
+    std::vector<uint8_t>  out(spadSim.OutputRowBytes(SpadSim::OUTPUT_BGRX) * height);
+    EXPECT_EQ(spadSim.OutputRowBytes(SpadSim::OUTPUT_RAW10), 125u);
+    EXPECT_EQ(spadSim.OutputRowBytes(SpadSim::OUTPUT_RAW12), 150u);
+
+    // unpacked RAW10 and RAW12 pixels are the 16-bit pixels clipped to 10 and
+    // 12 bits, with SIMD or scalar kernel
+    const uint32_t stages[2] = { SpadSim::STAGE_DF,
+        SpadSim::STAGE_LENS_DIST | SpadSim::STAGE_DF | SpadSim::STAGE_BLUR };
+    for (int ii = 0; ii < 2; ++ii)
+    {
+        spadSim.SetFrame(3);
+        spadSim.AddDistortionFormat(frame.data(), ref.data(), stages[ii], SpadSim::OUTPUT_GRAY16);
+        for (int simd = 0; simd < 2; ++simd)
+        {
+            spadSim.SetFrame(3);
+            spadSim.AddDistortionFormat(frame.data(), out.data(), stages[ii], SpadSim::OUTPUT_RAW10, simd != 0);
+            for (int Y = 0; Y < height; ++Y)
+            {
+                for (int X = 0; X < width; ++X)
+                {
+                    const uint8_t* p = out.data() + Y * 125 + X / 4 * 5;
+                    const uint32_t value = (p[X & 3] << 2) | ((p[4] >> (2 * (X & 3))) & 0x3);
+                    EXPECT_EQ(value, std::min(ref[Y * width + X], (uint16_t)1023));
+                }
+            }
+
+            spadSim.SetFrame(3);
+            spadSim.AddDistortionFormat(frame.data(), out.data(), stages[ii], SpadSim::OUTPUT_RAW12, simd != 0);
+            for (int Y = 0; Y < height; ++Y)
+            {
+                for (int X = 0; X < width; ++X)
+                {
+                    const uint8_t* p = out.data() + Y * 150 + X / 2 * 3;
+                    const uint32_t value = (p[X & 1] << 4) | ((p[2] >> (4 * (X & 1))) & 0xF);
+                    EXPECT_EQ(value, std::min(ref[Y * width + X], (uint16_t)4095));
+                }
+            }
+        }
+    }
+}
+
+TEST(SpadSimTests, FrameNoise) {
+    const int width  = 100;
+    const int height =  60;
+    SpadSim spadSim(width, height);
+    std::vector<uint32_t> frame(width * height, 300); // some on-the-fly Poisson samples
+    std::vector<uint32_t> out0(width * height);
+    std::vector<uint32_t> out1(width * height);
+    for (size_t i = 0; i < frame.size(); i += 2) { frame[i] = 100; }
+
+    // frame number advances so consecutive frames have different noise
+    spadSim.SetFrame(20);
+    spadSim.AddDistortion(frame.data(), out0.data());
+    EXPECT_EQ(spadSim.Frame(), 21u);
+    spadSim.AddDistortion(frame.data(), out1.data());
+    EXPECT_NE(memcmp(out0.data(), out1.data(), frame.size() * sizeof(uint32_t)), 0);
+
+    // regenerate frame 20
+    spadSim.SetFrame(20);
+    spadSim.AddDistortion(frame.data(), out1.data());
+    EXPECT_EQ(memcmp(out0.data(), out1.data(), frame.size() * sizeof(uint32_t)), 0);
+}
+
+TEST(SpadSimTests, DarkFrameCache) {
+    const int width  = 100;
+    const int height =  60;
+    SpadSim cachedSim(width, height);
+    SpadSim refSim(width, height);
+    cachedSim.SetDarkFrameCacheSize(2);
+    refSim.SetDarkFrameCacheSize(1); // rescales whenever temperature changes
+    std::vector<uint32_t> frame(width * height, 0); // dark frame and noise only
+    std::vector<uint32_t> out0(width * height);
+    std::vector<uint32_t> out1(width * height);
+
+    // cache hits, misses and replacements match rescaling D60
+    const float    temps[7] = { 40.0f, 70.0f,  50.0f, 40.0f, 70.0f, 70.01f, 70.0f };
+    const uint32_t exps[7]  = { 11111, 11111, 11111, 11111, 11111, 11111,   5555 };
+    for (int ii = 0; ii < 7; ++ii)
+    {
+        cachedSim.SetDarkFrame(temps[ii], 7.0f, exps[ii]);
+        refSim.SetDarkFrame(temps[ii], 7.0f, exps[ii]);
+        cachedSim.SetFrame(ii);
+        refSim.SetFrame(ii);
+        cachedSim.AddDistortion(frame.data(), out0.data(), false, true, false);
+        refSim.AddDistortion(frame.data(), out1.data(), false, true, false);
+        EXPECT_EQ(memcmp(out0.data(), out1.data(), frame.size() * sizeof(uint32_t)), 0) << "set " << ii;
+    }
+
+    // dark frame doubles every doubleTempC and scales with exposure
+    double means[3];
+    const float    meanTemps[3] = { 60.0f, 67.0f, 67.0f };
+    const uint32_t meanExps[3]  = { 11111, 11111, 5555 };
+    for (int ii = 0; ii < 3; ++ii)
+    {
+        cachedSim.SetDarkFrame(meanTemps[ii], 7.0f, meanExps[ii]);
+        cachedSim.AddDistortion(frame.data(), out0.data(), false, true, false);
+        double sum = 0;
+        for (size_t i = 0; i < frame.size(); ++i) { sum += out0[i] & 0xFF; }
+        means[ii] = sum / frame.size();
+    }
+    EXPECT_NEAR(means[1] / means[0], 2.0, 0.15);
+    EXPECT_NEAR(means[2] / means[1], 0.5, 0.05);
+}
+
+TEST(SpadSimTests, HotPixels) {
+    const int width  = 200;
+    const int height = 100;
+    SpadSim spadSim(width, height);
+    std::vector<uint32_t> frame(width * height, 0); // dark frame and noise only
+    std::vector<uint32_t> out0(width * height);
+    std::vector<uint32_t> out1(width * height);
+
+    // about 1% of pixels are hot (mean 80), the rest have mean 2
+    spadSim.AddDistortion(frame.data(), out0.data(), false, true, false);
+    int numHot = 0;
+    for (size_t i = 0; i < frame.size(); ++i) { numHot += (out0[i] & 0xFF) > 30; }
+    EXPECT_NEAR(numHot, 0.01 * frame.size(), 0.002 * frame.size());
+
+    // when hot enough the 8-bit base saturates and the excess of base pixels
+    // is added as hot pixels, SIMD still matches scalar
+    spadSim.SetDarkFrame(110.0f, 7.0f, 11111u);
+    for (int stages = 0; stages < 4; ++stages)
+    {
+        const bool enableLensDist = (stages & 1) != 0;
+        const bool enablePWL      = (stages & 2) != 0;
+        spadSim.SetFrame(3);
+        spadSim.AddDistortion(frame.data(), out0.data(), enableLensDist, true, enablePWL);
+        spadSim.SetFrame(3);
+        spadSim.AddDistortionScalar(frame.data(), out1.data(), enableLensDist, true, enablePWL);
+        EXPECT_EQ(memcmp(out0.data(), out1.data(), frame.size() * sizeof(uint32_t)), 0);
+    }
+}
+
+TEST(SpadSimTests, NoiseLUT) {
+    const int width  = 200;
+    const int height = 100;
+    SpadSim lutSim(width, height);                 // noise LUTs up to 4096
+    SpadSim exactSim(width, height, 1u, 2u, 256u); // noise LUT up to 256 only
+    std::vector<uint32_t> frame(width * height);
+    std::vector<uint32_t> out0(width * height);
+    std::vector<uint32_t> out1(width * height);
+    std::vector<int32_t>  diff(width * height);
+
+    // noise of quantile LUTs has the same statistics as Poisson samples:
+    // compare the mean and the noise variance (from the mean square difference
+    // of two frames, so vignetting cancels)
+    const uint32_t values[3] = { 600, 1500, 4000 };
+    for (int ii = 0; ii < 3; ++ii)
+    {
+        std::fill(frame.begin(), frame.end(), values[ii]);
+        double means[2], noiseVars[2];
+        for (int sim = 0; sim < 2; ++sim)
+        {
+            SpadSim& spadSim = sim ? exactSim : lutSim;
+            double sum = 0, sumDiff2 = 0;
+            for (int f = 0; f < 10; ++f)
+            {
+                spadSim.AddDistortion(frame.data(), out0.data(), false, false, true);
+                spadSim.AddDistortion(frame.data(), out1.data(), false, false, true);
+                for (size_t i = 0; i < frame.size(); ++i)
+                {
+                    const int32_t d = (int32_t)(out0[i] & 0xFF) - (int32_t)(out1[i] & 0xFF);
+                    sum      += (out0[i] & 0xFF) + (out1[i] & 0xFF);
+                    sumDiff2 += d * d;
+                }
+            }
+            means[sim]     = sum      / (20.0 * frame.size());
+            noiseVars[sim] = sumDiff2 / (20.0 * frame.size());
+        }
+        EXPECT_NEAR(means[0],     means[1],     0.02) << "value " << values[ii];
+        EXPECT_NEAR(noiseVars[0], noiseVars[1], 0.02 * noiseVars[1]) << "value " << values[ii];
+    }
+}
+
+TEST(SpadSimTests, NoiseCorrelation) {
+    const int width  = 1008; // 1008 + 16 = 4 * 256
+    const int height =  768;
+    SpadSim spadSim(width, height);
+    std::vector<uint32_t> frame(width * height, 2);
+    std::vector<uint32_t> out(width * height);
+
+    // within half the max radius vignetting leaves value 1, so the noise of
+    // pixels there comes from the same noise LUT row and must be uncorrelated
+    // at any lag, in particular multiples of the 256 LUT columns
+    const int lags[5][2] = { { 1, 0 }, { 32, 0 }, { 256, 0 }, { 16, 1 }, { 0, 1 } };
+    const int maxR2 = 280 * 280;
+    for (int ii = 0; ii < 5; ++ii)
+    {
+        const int dX = lags[ii][0];
+        const int dY = lags[ii][1];
+        double n = 0, sumA = 0, sumB = 0, sumAA = 0, sumBB = 0, sumAB = 0;
+        for (int f = 0; f < 4; ++f)
+        {
+            spadSim.AddDistortion(frame.data(), out.data(), false, false, false);
+            for (int Y = 0; Y + dY < height; ++Y)
+            {
+                for (int X = 0; X + dX < width; ++X)
+                {
+                    const int rA2 = (X - width / 2) * (X - width / 2) + (Y - height / 2) * (Y - height / 2);
+                    const int rB2 = (X + dX - width / 2) * (X + dX - width / 2) + (Y + dY - height / 2) * (Y + dY - height / 2);
+                    if ((rA2 >= maxR2) || (rB2 >= maxR2)) { continue; }
+
+                    const double a = out[Y * width + X] & 0xFF;
+                    const double b = out[(Y + dY) * width + X + dX] & 0xFF;
+                    n += 1; sumA += a; sumB += b; sumAA += a * a; sumBB += b * b; sumAB += a * b;
+                }
+            }
+        }
+        const double meanA = sumA / n;
+        const double meanB = sumB / n;
+        const double corr = (sumAB / n - meanA * meanB) /
+            sqrt((sumAA / n - meanA * meanA) * (sumBB / n - meanB * meanB));
+        EXPECT_NEAR(corr, 0.0, 0.01) << "lag " << dX << ", " << dY;
+    }
+}
+
+TEST(SpadSimTests, LensBlur) {
+    const int width  = 100; // not a multiple of SIMD width
+    const int height =  60;
+    SpadSim spadSim(width, height);
+    std::vector<uint32_t> frame(width * height);
+    std::vector<uint32_t> refOut(width * height);
+    std::vector<uint32_t> blurOut(width * height);
+    srand(7);
+    for (size_t i = 0; i < frame.size(); ++i) { frame[i] = rand() % 320; }
+
+    const uint32_t stages = SpadSim::STAGE_LENS_DIST | SpadSim::STAGE_DF | SpadSim::STAGE_PWL;
+
+    // identity kernels must match no blur
+    const float delta[5]    = { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+    float       delta2D[25] = {};
+    delta2D[12] = 3.0f; // normalized to 1
+    spadSim.SetFrame(8);
+    spadSim.AddDistortionStages(frame.data(), refOut.data(), stages);
+    spadSim.SetBlurKernel(delta, delta, 2);
+    spadSim.SetFrame(8);
+    spadSim.AddDistortionStages(frame.data(), blurOut.data(), stages | SpadSim::STAGE_BLUR);
+    EXPECT_EQ(memcmp(refOut.data(), blurOut.data(), frame.size() * sizeof(uint32_t)), 0);
+    spadSim.SetBlurKernel2D(delta2D, 2);
+    spadSim.SetFrame(8);
+    spadSim.AddDistortionStages(frame.data(), blurOut.data(), stages | SpadSim::STAGE_BLUR);
+    EXPECT_EQ(memcmp(refOut.data(), blurOut.data(), frame.size() * sizeof(uint32_t)), 0);
+
+    // SIMD matches scalar for separable and non-separable kernels
+    const float gauss[7]    = { 1.0f, 6.0f, 15.0f, 20.0f, 15.0f, 6.0f, 1.0f };
+    const float box[3]      = { 1.0f, 1.0f, 1.0f };
+    const float cross2D[25] = { 0, 0, 1, 0, 0,
+                                0, 1, 2, 1, 0,
+                                1, 2, 4, 2, 1,
+                                0, 1, 2, 1, 0,
+                                0, 0, 1, 0, 0 };
+    for (int kernel = 0; kernel < 3; ++kernel)
+    {
+        if (kernel == 0) { spadSim.SetBlurKernel(gauss, gauss, 3); }
+        if (kernel == 1) { spadSim.SetBlurKernel(box, gauss + 2, 1); }
+        if (kernel == 2) { spadSim.SetBlurKernel2D(cross2D, 2); }
+        for (uint32_t bilinear = 0; bilinear <= SpadSim::STAGE_BILINEAR; bilinear += SpadSim::STAGE_BILINEAR)
+        {
+            const uint32_t mask = stages | bilinear | SpadSim::STAGE_BLUR;
+            spadSim.SetFrame(9);
+            spadSim.AddDistortionStages(frame.data(), refOut.data(), mask, false);
+            spadSim.SetFrame(9);
+            spadSim.AddDistortionStages(frame.data(), blurOut.data(), mask, true);
+            EXPECT_EQ(memcmp(refOut.data(), blurOut.data(), frame.size() * sizeof(uint32_t)), 0);
+        }
+    }
+}
+
+TEST(SpadSimTests, LensBlurResponse) {
+    const int width  = 100;
+    const int height =  60;
+    SpadSim spadSim(width, height); // default 3x3 binomial kernel
+    std::vector<uint32_t> frame(width * height);
+    std::vector<uint32_t> expected(width * height);
+    std::vector<uint16_t> refOut(width * height);
+    std::vector<uint16_t> blurOut(width * height);
+
+    // Noise depends only on pixel value, position and frame, so blurring a
+    // frame gives the same output as the expected blurred frame without blur
+
+    // flat field is unchanged by the default kernel, including at the edges
+    std::fill(frame.begin(), frame.end(), 300u);
+    for (int simd = 0; simd < 2; ++simd)
+    {
+        spadSim.SetFrame(4);
+        spadSim.AddDistortionStages(frame.data(), refOut.data(), 0u, simd != 0);
+        spadSim.SetFrame(4);
+        spadSim.AddDistortionStages(frame.data(), blurOut.data(), SpadSim::STAGE_BLUR, simd != 0);
+        EXPECT_EQ(memcmp(refOut.data(), blurOut.data(), refOut.size() * sizeof(uint16_t)), 0);
+    }
+
+    // impulse response is the quantized taps. The taps of 7-tap binomial are
+    // {1, 6, 15, 20, 15, 6, 1} / 64, i.e. multiples of 16 with 10 fractional
+    // bits, and an impulse of 2^18 keeps the vertical then horizontal passes
+    // exact: 2^18 * tapY * tapX / 2^20
+    const float gauss[7] = { 1.0f, 6.0f, 15.0f, 20.0f, 15.0f, 6.0f, 1.0f };
+    spadSim.SetBlurKernel(gauss, gauss, 3);
+    const int X0 = 50;
+    const int Y0 = 30;
+    std::fill(frame.begin(), frame.end(), 0u);
+    std::fill(expected.begin(), expected.end(), 0u);
+    frame[Y0 * width + X0] = 1u << 18;
+    for (int jj = 0; jj < 7; ++jj)
+    {
+        for (int ii = 0; ii < 7; ++ii)
+        {
+            const uint32_t tapY = (uint32_t)gauss[jj] * 16;
+            const uint32_t tapX = (uint32_t)gauss[ii] * 16;
+            expected[(Y0 + jj - 3) * width + X0 + ii - 3] = tapY * tapX / 4;
+        }
+    }
+    for (int simd = 0; simd < 2; ++simd)
+    {
+        spadSim.SetFrame(5);
+        spadSim.AddDistortionStages(expected.data(), refOut.data(), 0u, simd != 0);
+        spadSim.SetFrame(5);
+        spadSim.AddDistortionStages(frame.data(), blurOut.data(), SpadSim::STAGE_BLUR, simd != 0);
+        EXPECT_EQ(memcmp(refOut.data(), blurOut.data(), refOut.size() * sizeof(uint16_t)), 0);
+    }
+}
+
+TEST(SpadSimTests, BlurZones) {
+    const int width  = 100; // not a multiple of SIMD width
+    const int height =  60;
+    SpadSim spadSim(width, height);
+    std::vector<uint32_t> frame(width * height);
+    std::vector<uint32_t> refOut(width * height);
+    std::vector<uint32_t> blurOut(width * height);
+
+    // pixels < 256 so noise is all from LUT and does not depend on other pixels
+    srand(10);
+    for (size_t i = 0; i < frame.size(); ++i) { frame[i] = rand() % 200; }
+    const uint32_t stages = SpadSim::STAGE_LENS_DIST | SpadSim::STAGE_BLUR;
+
+    // zones with the same kernel match a single kernel
+    const float gauss[5]    = { 1.0f, 4.0f, 6.0f, 4.0f, 1.0f };
+    const float delta[5]    = { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+    const int   zoneRadius[2] = { 15, 35 };
+    float kernels[3 * 5];
+    for (int zone = 0; zone < 3; ++zone) { memcpy(kernels + zone * 5, gauss, sizeof(gauss)); }
+    spadSim.SetBlurKernel(gauss, gauss, 2);
+    spadSim.SetFrame(11);
+    spadSim.AddDistortionStages(frame.data(), refOut.data(), stages);
+    spadSim.SetBlurZones(kernels, kernels, zoneRadius, 3, 2);
+    spadSim.SetFrame(11);
+    spadSim.AddDistortionStages(frame.data(), blurOut.data(), stages);
+    EXPECT_EQ(memcmp(refOut.data(), blurOut.data(), frame.size() * sizeof(uint32_t)), 0);
+
+    // no blur in the center zone only
+    memcpy(kernels, delta, sizeof(delta));
+    spadSim.SetBlurZones(kernels, kernels, zoneRadius, 3, 2);
+    spadSim.SetFrame(11);
+    spadSim.AddDistortionStages(frame.data(), blurOut.data(), stages);
+    spadSim.SetFrame(11);
+    spadSim.AddDistortionStages(frame.data(), refOut.data(), stages & ~SpadSim::STAGE_BLUR);
+    int numOuterDiff = 0;
+    for (int Y = 0; Y < height; ++Y)
+    {
+        for (int X = 0; X < width; ++X)
+        {
+            const int r2 = (Y - height / 2) * (Y - height / 2) + (X - width / 2) * (X - width / 2);
+            const bool same = refOut[Y * width + X] == blurOut[Y * width + X];
+            if (r2 < 15 * 15) { EXPECT_TRUE(same); }
+            else if (!same)   { numOuterDiff++; }
+        }
+    }
+    EXPECT_GT(numOuterDiff, 0);
+
+    // SIMD matches scalar
+    spadSim.SetFrame(12);
+    spadSim.AddDistortionStages(frame.data(), refOut.data(), stages | SpadSim::STAGE_DF, false);
+    spadSim.SetFrame(12);
+    spadSim.AddDistortionStages(frame.data(), blurOut.data(), stages | SpadSim::STAGE_DF, true);
+    EXPECT_EQ(memcmp(refOut.data(), blurOut.data(), frame.size() * sizeof(uint32_t)), 0);
+}
+
 // TODO: timing test for rendering 200 frames
 // TODO: timing test for pipeline processing 200 frames
 // TODO: average linear frames to obtain original dark frame